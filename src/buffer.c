@@ -16,6 +16,11 @@
 #include <stdio.h>
 #include <string.h>
 #include <errno.h>
+#include <unistd.h>
+#include <sys/uio.h>
+#ifdef USE_THREADS
+#include <pthread.h>
+#endif
 
 #include "definitions.h"
 #include "util.h"
@@ -33,20 +38,357 @@ typedef enum {
 	BUFFERING_INITIAL
 } PrintState;
 
-static CharBuffer *contextBuffers;
+/* The buffered context is kept in a single arena. Only the part of the arena
+   starting at contextStart is still needed, and the space before it is
+   reclaimed when the arena runs full. The ends of the complete lines in the
+   arena are kept in a ring of option.contextLines + 1 offsets, such that the
+   oldest line can be dropped when a new line is completed. */
+static CharBuffer contextArena;
+static size_t contextStart;
+static size_t *lineEnds;
+static int firstLine, bufferedLines;
 static PrintState state = PRE_BUFFERING_INITIAL;
-static int bufferIndex;
 static int afterContextLines;
 
+/* All output is collected in a single buffer, which is written to the output
+   file descriptor directly. This avoids the per-character locking and
+   function call overhead of putc, which dominates when printing large,
+   mostly unchanged files. */
+#define OUTPUT_BUFFER_SIZE 65536
+static char outputStorage[OUTPUT_BUFFER_SIZE];
+static char *outputBuffer = outputStorage;
+static size_t outputFill;
+
+#ifdef USE_THREADS
+/* With --output-buffers, full buffers are written by a separate thread, such
+   that producing the output continues while the output is blocked by a slow
+   reader. The buffers form a ring of outputBlockCount blocks: the block
+   fillBlock is filled by the main thread, and the queuedBlocks blocks starting
+   at writeBlock are waiting to be written. When all blocks are queued, the
+   main thread waits for the writer. */
+static pthread_mutex_t writerLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t writerCond = PTHREAD_COND_INITIALIZER;
+static bool writerRunning;
+static char *outputBlocks;
+static size_t *blockFill;
+static int outputBlockCount, fillBlock, writeBlock, queuedBlocks;
+/* The first error encountered by the writer thread, or 0. */
+static int writerError;
+#endif
+
+/* The number of bytes written to the output so far, for --profile-phases.
+   While the writer thread runs, it is only accessed with writerLock held. */
+static long long bytesWritten;
+/* Set when writing the output failed, such that the output is not written
+   again when exiting. */
+static bool writeFailed;
+
+/** Write a set of buffers to the output file descriptor, retrying on short writes.
+	@param iov The buffers to write. The contents of @a iov are modified.
+	@param count The number of buffers in @a iov.
+	@param total The counter to add the number of bytes written to.
+	@return 0 on success, or the error number of the failed write.
+*/
+static int writeBuffers(struct iovec *iov, int count, long long *total) {
+	int fd = fileno(option.output);
+	ssize_t written;
+
+	while (count > 0) {
+		if ((written = writev(fd, iov, count)) < 0) {
+			if (errno == EINTR)
+				continue;
+			return errno;
+		}
+		*total += written;
+		/* Skip the buffers which were written completely, and adjust the
+		   first partially written buffer. */
+		while (count > 0 && (size_t) written >= iov->iov_len) {
+			written -= iov->iov_len;
+			iov++;
+			count--;
+		}
+		if (count > 0) {
+			iov->iov_base = (char *) iov->iov_base + written;
+			iov->iov_len -= written;
+		}
+	}
+	return 0;
+}
+
+/** Report a failure to write the output.
+	@param error The error number of the failure, or 0 if there was none.
+*/
+static void checkWriteError(int error) {
+	if (error != 0) {
+		writeFailed = true;
+		fatal(_("Error writing output: %s\n"), strerror(error));
+	}
+}
+
+#ifdef USE_THREADS
+/** Write the queued blocks, in the writer thread. */
+static void *writerThread(void *arg) {
+	struct iovec iov;
+	long long written;
+	int error;
+
+	(void) arg;
+
+	pthread_mutex_lock(&writerLock);
+	for (;;) {
+		while (queuedBlocks == 0)
+			pthread_cond_wait(&writerCond, &writerLock);
+		iov.iov_base = outputBlocks + (size_t) writeBlock * OUTPUT_BUFFER_SIZE;
+		iov.iov_len = blockFill[writeBlock];
+		/* After an error, the remaining output is discarded. */
+		error = writerError;
+		pthread_mutex_unlock(&writerLock);
+
+		written = 0;
+		if (error == 0)
+			error = writeBuffers(&iov, 1, &written);
+
+		pthread_mutex_lock(&writerLock);
+		bytesWritten += written;
+		writerError = error;
+		writeBlock = (writeBlock + 1) % outputBlockCount;
+		queuedBlocks--;
+		pthread_cond_broadcast(&writerCond);
+	}
+	return NULL;
+}
+
+/** Queue the filled block for the writer thread, and continue in the next block.
+
+	If all blocks are queued, this waits until the writer thread has written
+	the oldest block.
+*/
+static void queueOutput(void) {
+	int error;
+
+	pthread_mutex_lock(&writerLock);
+	blockFill[fillBlock] = outputFill;
+	queuedBlocks++;
+	pthread_cond_broadcast(&writerCond);
+	while (queuedBlocks == outputBlockCount)
+		pthread_cond_wait(&writerCond, &writerLock);
+	error = writerError;
+	pthread_mutex_unlock(&writerLock);
+	checkWriteError(error);
+
+	fillBlock = (fillBlock + 1) % outputBlockCount;
+	outputBuffer = outputBlocks + (size_t) fillBlock * OUTPUT_BUFFER_SIZE;
+	outputFill = 0;
+}
+#endif
+
+/** Write the buffered output when exiting, for exits through @a fatal.
+
+	Errors are ignored, as this runs from @a exit. After a write error, the
+	output is not written again.
+*/
+static void flushOutputOnExit(void) {
+	struct iovec iov;
+	long long written = 0;
+
+	if (writeFailed)
+		return;
+#ifdef USE_THREADS
+	if (writerRunning) {
+		int error;
+
+		pthread_mutex_lock(&writerLock);
+		while (queuedBlocks > 0)
+			pthread_cond_wait(&writerCond, &writerLock);
+		error = writerError;
+		pthread_mutex_unlock(&writerLock);
+		if (error != 0)
+			return;
+	}
+#endif
+	iov.iov_base = outputBuffer;
+	iov.iov_len = outputFill;
+	if (outputFill != 0)
+		writeBuffers(&iov, 1, &written);
+	outputFill = 0;
+}
+
+/** Make sure the buffered output is written when exiting because of an error. */
+void initOutput(void) {
+	atexit(flushOutputOnExit);
+}
+
+/** Set up writing the output from a separate thread, for --output-buffers.
+	@param count The number of output buffers to use, at least 2.
+
+	If the thread can not be started, the output is written directly.
+*/
+void initOutputBuffers(int count) {
+#ifdef USE_THREADS
+	pthread_t thread;
+
+	if (writerRunning)
+		return;
+	outputBlocks = safe_malloc((size_t) count * OUTPUT_BUFFER_SIZE);
+	blockFill = safe_malloc((size_t) count * sizeof(size_t));
+	outputBlockCount = count;
+	if (pthread_create(&thread, NULL, writerThread, NULL) != 0) {
+		free(outputBlocks);
+		free(blockFill);
+		return;
+	}
+	pthread_detach(thread);
+	writerRunning = true;
+	/* Move any output produced so far to the first block. */
+	memcpy(outputBlocks, outputBuffer, outputFill);
+	outputBuffer = outputBlocks;
+#else
+	(void) count;
+#endif
+}
+
+/** Pass the buffered output on to be written, without waiting for it to be written. */
+void outputSubmit(void) {
+	struct iovec iov;
+
+	if (outputFill == 0)
+		return;
+#ifdef USE_THREADS
+	if (writerRunning) {
+		queueOutput();
+		return;
+	}
+#endif
+	iov.iov_base = outputBuffer;
+	iov.iov_len = outputFill;
+	checkWriteError(writeBuffers(&iov, 1, &bytesWritten));
+	outputFill = 0;
+}
+
+/** Write all buffered output, and wait until it has been written. */
+void outputFlush(void) {
+	outputSubmit();
+#ifdef USE_THREADS
+	if (writerRunning) {
+		int error;
+
+		pthread_mutex_lock(&writerLock);
+		while (queuedBlocks > 0)
+			pthread_cond_wait(&writerCond, &writerLock);
+		error = writerError;
+		pthread_mutex_unlock(&writerLock);
+		checkWriteError(error);
+	}
+#endif
+}
+
+/** Get the number of bytes written to the output so far.
+
+	Output which has not been flushed with @a outputFlush is not included.
+*/
+long long getBytesWritten(void) {
+	long long result;
+
+#ifdef USE_THREADS
+	if (writerRunning)
+		pthread_mutex_lock(&writerLock);
+#endif
+	result = bytesWritten;
+#ifdef USE_THREADS
+	if (writerRunning)
+		pthread_mutex_unlock(&writerLock);
+#endif
+	return result;
+}
+
+/** Append a string to the output buffer.
+	@param data The bytes to write.
+	@param bytes The number of bytes in @a data.
+
+	If @a data does not fit in the output buffer, the buffered output and
+	@a data are written using a single system call. When writing from a
+	separate thread, @a data is copied into the following buffers instead.
+*/
+void outputWrite(const char *data, size_t bytes) {
+	struct iovec iov[2];
+
+	if (bytes <= OUTPUT_BUFFER_SIZE - outputFill) {
+		memcpy(outputBuffer + outputFill, data, bytes);
+		outputFill += bytes;
+		return;
+	}
+#ifdef USE_THREADS
+	if (writerRunning) {
+		while (bytes > 0) {
+			size_t chunk = bytes < OUTPUT_BUFFER_SIZE - outputFill ? bytes : OUTPUT_BUFFER_SIZE - outputFill;
+
+			memcpy(outputBuffer + outputFill, data, chunk);
+			outputFill += chunk;
+			data += chunk;
+			bytes -= chunk;
+			if (outputFill == OUTPUT_BUFFER_SIZE)
+				queueOutput();
+		}
+		return;
+	}
+#endif
+	iov[0].iov_base = outputBuffer;
+	iov[0].iov_len = outputFill;
+	iov[1].iov_base = (char *) data;
+	iov[1].iov_len = bytes;
+	checkWriteError(writeBuffers(iov, 2, &bytesWritten));
+	outputFill = 0;
+}
+
+/** Append a single character to the output buffer. */
+static void outputChar(char c) {
+	if (outputFill == OUTPUT_BUFFER_SIZE)
+		outputSubmit();
+	outputBuffer[outputFill++] = c;
+}
+
 /** Initialize the context buffers. */
 void initContextBuffers(void) {
+	errno = 0;
+	lineEnds = (size_t *) safe_malloc(((size_t) option.contextLines + 1) * sizeof(size_t));
+	VECTOR_INIT_ALLOCATED(contextArena);
+}
+
+/** Discard all buffered context. */
+static void resetContext(void) {
+	contextArena.used = 0;
+	contextStart = 0;
+	firstLine = 0;
+	bufferedLines = 0;
+}
+
+/** Reset the context buffering, to start printing another output. */
+void resetOutputState(void) {
+	state = PRE_BUFFERING_INITIAL;
+	afterContextLines = 0;
+	resetContext();
+}
+
+/** Ensure that there is room for @a bytes more bytes in the context arena.
+
+	The space of dropped lines is only reclaimed if that frees at least half
+	of the arena, to ensure that the cost of moving the data is amortized over
+	the bytes appended in between.
+*/
+static void allocateContext(size_t bytes) {
 	int i;
 
-	errno = 0;
-	contextBuffers = (CharBuffer *) safe_malloc((option.contextLines + 1) * sizeof(CharBuffer));
+	if (contextArena.allocated > contextArena.used + bytes)
+		return;
 
-	for (i = 0; i <= option.contextLines; i++)
-		VECTOR_INIT(contextBuffers[i]);
+	if (contextStart >= contextArena.used / 2) {
+		memmove(contextArena.data, contextArena.data + contextStart, contextArena.used - contextStart);
+		contextArena.used -= contextStart;
+		for (i = 0; i < bufferedLines; i++)
+			lineEnds[(firstLine + i) % (option.contextLines + 1)] -= contextStart;
+		contextStart = 0;
+	}
+	VECTOR_ALLOCATE(contextArena, bytes);
 }
 
 /** Write a character, buffering if necessary.
@@ -55,11 +397,8 @@ void initContextBuffers(void) {
 		the old and the new file.
 */
 void addchar(char c, bool common) {
-	/* Using ignore variable to shut up gcc about the warn_unused_result attribute set on fwrite. */
-	int i, ignore;
-
 	if (!option.context) {
-		putc(c, option.output);
+		outputChar(c);
 		return;
 	}
 
@@ -70,22 +409,16 @@ void addchar(char c, bool common) {
 			case PRINTING_CHANGED:
 			case PRINTING_AFTER_CONTEXT:
 				break;
-			/* If we have entered a regular buffering state, all buffers are in use.
-			   However, the set of buffers is used as a ring buffer so first print all
-			   buffers after the current one, then print all buffers before the current. */
+			/* If we have entered a regular buffering state, lines have been
+			   dropped since the last output, so print a separator first. */
 			case BUFFERING:
-				ignore = fwrite("--\n", 1, 3, option.output);
-        /* FALLTHROUGH */
-			case BUFFERING_INITIAL:
-				for (i = bufferIndex + 1; i <= option.contextLines; i++)
-					ignore = fwrite(contextBuffers[i].data, 1, contextBuffers[i].used, option.output);
+				outputWrite("--\n", 3);
 				/* FALLTHROUGH */
-			/* In pre-buffering state, only the first buffers are used. Once we start
-			   wrapping around, we change state to a regular buffering state. */
+			case BUFFERING_INITIAL:
 			case PRE_BUFFERING:
 			case PRE_BUFFERING_INITIAL:
-				for (i = 0; i <= bufferIndex; i++)
-					ignore = fwrite(contextBuffers[i].data, 1, contextBuffers[i].used, option.output);
+				outputWrite(contextArena.data + contextStart, contextArena.used - contextStart);
+				resetContext();
 				break;
 			default:
 				PANIC();
@@ -99,11 +432,12 @@ void addchar(char c, bool common) {
 		case PRE_BUFFERING:
 		case BUFFERING_INITIAL:
 		case PRE_BUFFERING_INITIAL:
-			VECTOR_APPEND(contextBuffers[bufferIndex], c);
+			allocateContext(1);
+			contextArena.data[contextArena.used++] = c;
 			break;
 		case PRINTING_AFTER_CONTEXT:
 		case PRINTING_CHANGED:
-			putc(c, option.output);
+			outputChar(c);
 			break;
 		default:
 			PANIC();
@@ -114,6 +448,7 @@ void addchar(char c, bool common) {
 			case PRINTING_CHANGED:
 				if (option.contextLines == 0) {
 					state = PRE_BUFFERING;
+					resetContext();
 					break;
 				}
 				state = PRINTING_AFTER_CONTEXT;
@@ -123,80 +458,248 @@ void addchar(char c, bool common) {
 				afterContextLines++;
 				if (afterContextLines == option.contextLines) {
 					state = PRE_BUFFERING;
-					bufferIndex = 0;
+					resetContext();
 				}
 				break;
 			case PRE_BUFFERING_INITIAL:
 			case PRE_BUFFERING:
-				bufferIndex++;
-				/* Once we have filled all buffers, we change to a regular buffering state. */
-				if (bufferIndex > option.contextLines) {
-					state = state == PRE_BUFFERING ? BUFFERING : BUFFERING_INITIAL;
-					bufferIndex = 0;
-				}
-				break;
 			case BUFFERING_INITIAL:
 			case BUFFERING:
-				bufferIndex++;
-				if (bufferIndex > option.contextLines)
-					bufferIndex = 0;
+				lineEnds[(firstLine + bufferedLines) % (option.contextLines + 1)] = contextArena.used;
+				bufferedLines++;
+				/* Once we have more lines than needed for the context, drop the
+				   oldest line and change to a regular buffering state. */
+				if (bufferedLines > option.contextLines) {
+					contextStart = lineEnds[firstLine];
+					firstLine = (firstLine + 1) % (option.contextLines + 1);
+					bufferedLines--;
+					if (state == PRE_BUFFERING)
+						state = BUFFERING;
+					else if (state == PRE_BUFFERING_INITIAL)
+						state = BUFFERING_INITIAL;
+				}
 				break;
 			default:
 				PANIC();
 		}
-		/* We just saw a newline, so we have either entered a buffering state,
-		   or already were in one, and finished filling the old buffer. The new
-		   buffer must be filled from the start. */
-		contextBuffers[bufferIndex].used = 0;
 	}
 }
 
-/* Macro to ensure we use the same format and arguments for printing the line
-   number information in all print statements. */
-#define LINENUMBERS_FMT_ARGS "%*d:%-*d ", option.lineNumbers, oldLineNumber, option.lineNumbers, newLineNumber
+/** Discard the buffered context, because the output up to the next change is skipped.
+	@return A boolean indicating whether the output can be skipped.
+
+	The output can only be skipped once the context after the last change has
+	been printed. The caller must ensure that there will be more than
+	option.contextLines lines of output between the point it skips to and
+	the next change, such that the skipped output would have been dropped
+	from the context buffers anyway.
+*/
+bool skipContext(void) {
+	switch (state) {
+		case PRINTING_CHANGED:
+		case PRINTING_AFTER_CONTEXT:
+			return false;
+		case PRE_BUFFERING:
+		case BUFFERING:
+			state = BUFFERING;
+			break;
+		case PRE_BUFFERING_INITIAL:
+		case BUFFERING_INITIAL:
+			state = BUFFERING_INITIAL;
+			break;
+		default:
+			PANIC();
+	}
+	resetContext();
+	return true;
+}
+
+/** Write a string of characters, buffering if necessary.
+	@param data The characters to write.
+	@param bytes The number of characters in @a data.
+	@param common Boolean to indicate whether the characters belong to both
+		the old and the new file.
+*/
+void addchars(const char *data, size_t bytes, bool common) {
+	if (!option.context) {
+		outputWrite(data, bytes);
+		return;
+	}
+
+	/* The state can only change on the first character of a run, because of
+	   flushing the buffered context, or on a newline. So the characters in
+	   between can be written as a single string. */
+	while (bytes > 0) {
+		const char *newline = memchr(data, '\n', bytes);
+		size_t run = newline == NULL ? bytes : (size_t) (newline - data) + 1;
+
+		addchar(*data, common);
+		if (run > 1) {
+			if (newline != NULL) {
+				writeString(data + 1, run - 2);
+				addchar('\n', common);
+			} else {
+				writeString(data + 1, run - 1);
+			}
+		}
+		data += run;
+		bytes -= run;
+	}
+}
+
+/* Pairs of decimal digits, such that a number can be converted two digits at a time. */
+static const char digitPairs[] =
+	"0001020304050607080910111213141516171819202122232425262728293031323334353637383940414243444546474849"
+	"5051525354555657585960616263646566676869707172737475767778798081828384858687888990919293949596979899";
+
+/* The maximum number of digits in a line number. */
+#define MAX_LINENUMBER_DIGITS 10
+
+/** Convert a line number to decimal digits.
+	@param end The location after the last digit to write.
+	@param value The line number to convert.
+	@return The location of the first digit written.
+
+	The digits are written backwards from @a end, which must be preceded by
+	room for at least MAX_LINENUMBER_DIGITS digits.
+*/
+static char *formatNumber(char *end, unsigned int value) {
+	while (value >= 100) {
+		end -= 2;
+		memcpy(end, digitPairs + (value % 100) * 2, 2);
+		value /= 100;
+	}
+	if (value >= 10) {
+		end -= 2;
+		memcpy(end, digitPairs + value * 2, 2);
+	} else {
+		*--end = '0' + value;
+	}
+	return end;
+}
+
+/** Write the line number information in the same format as printf("%*d:%-*d ").
+	@param buffer The location to write the line number information, which
+		must have room for at least @a lineNumberSize bytes.
+	@param oldLineNumber The line number in the old file.
+	@param newLineNumber The line number in the new file.
+	@return The location after the last byte written.
+*/
+static char *formatLineNumbers(char *buffer, int oldLineNumber, int newLineNumber) {
+	char digits[MAX_LINENUMBER_DIGITS];
+	char *start;
+	size_t length;
+
+	start = formatNumber(digits + MAX_LINENUMBER_DIGITS, oldLineNumber);
+	length = digits + MAX_LINENUMBER_DIGITS - start;
+	if (length < (size_t) option.lineNumbers) {
+		memset(buffer, ' ', option.lineNumbers - length);
+		buffer += option.lineNumbers - length;
+	}
+	memcpy(buffer, start, length);
+	buffer += length;
+	*buffer++ = ':';
+
+	start = formatNumber(digits + MAX_LINENUMBER_DIGITS, newLineNumber);
+	length = digits + MAX_LINENUMBER_DIGITS - start;
+	memcpy(buffer, start, length);
+	buffer += length;
+	if (length < (size_t) option.lineNumbers) {
+		memset(buffer, ' ', option.lineNumbers - length);
+		buffer += option.lineNumbers - length;
+	}
+	*buffer++ = ' ';
+	return buffer;
+}
 
 /** Print line number information, buffering if necessary.
 	@param oldLineNumber The line number in the old file.
 	@param newLineNumber The line number in the new file.
+
+	The line number information is formatted directly into the output buffer
+	when possible, and otherwise into a scratch buffer which is large enough
+	for any line number at the width from option.lineNumbers.
 */
 void printLineNumbers(int oldLineNumber, int newLineNumber) {
-	int printed, allowed;
+	static CharBuffer lineNumberBuffer;
+	static int lineNumberWidth;
+	static size_t lineNumberSize;
+	char *end;
 
-	if (!option.context) {
-		printf(LINENUMBERS_FMT_ARGS);
+	/* Two numbers of at least the width from option.lineNumbers, a colon and a space. */
+	if (lineNumberWidth != option.lineNumbers) {
+		lineNumberWidth = option.lineNumbers;
+		lineNumberSize = 2 * (size_t) (lineNumberWidth > MAX_LINENUMBER_DIGITS ? lineNumberWidth : MAX_LINENUMBER_DIGITS) + 2;
+		VECTOR_ALLOCATE(lineNumberBuffer, lineNumberSize);
+	}
+
+	if (!option.context && OUTPUT_BUFFER_SIZE - outputFill >= lineNumberSize) {
+		end = formatLineNumbers(outputBuffer + outputFill, oldLineNumber, newLineNumber);
+		outputFill = end - outputBuffer;
 		return;
 	}
+	end = formatLineNumbers(lineNumberBuffer.data, oldLineNumber, newLineNumber);
+	writeString(lineNumberBuffer.data, end - lineNumberBuffer.data);
+}
 
-	switch (state) {
-		case BUFFERING:
-		case PRE_BUFFERING:
-		case BUFFERING_INITIAL:
-		case PRE_BUFFERING_INITIAL:
-			allowed = contextBuffers[bufferIndex].allocated - contextBuffers[bufferIndex].used;
-			/* SUSv2 specification of snprintf does not handle zero sized buffers nicely :-(
-			   Therefore, we have to ensure that there is at least room for one byte, but as
-			   we will be printing 2 numbers and a colon and a space, we might as well ask for
-			   4 bytes. */
-			VECTOR_ALLOCATE(contextBuffers[bufferIndex], 4);
-			printed = snprintf(contextBuffers[bufferIndex].data + contextBuffers[bufferIndex].used, allowed, LINENUMBERS_FMT_ARGS);
-			/* If there was not enough room to hold all the bytes for the line numbers,
-			   resize the buffer and try again. */
-			if (printed > allowed) {
-				VECTOR_ALLOCATE(contextBuffers[bufferIndex], printed);
-				allowed = contextBuffers[bufferIndex].allocated - contextBuffers[bufferIndex].used;
-				printed = snprintf(contextBuffers[bufferIndex].data + contextBuffers[bufferIndex].used, allowed, LINENUMBERS_FMT_ARGS);
-			}
-			/* Sanity check: the number of characters printed should be at least 2
-			   [probably 4, but I don't know all possible number systems]. */
-			ASSERT(printed >= 2);
-			contextBuffers[bufferIndex].used += printed;
-			break;
-		case PRINTING_AFTER_CONTEXT:
-		case PRINTING_CHANGED:
-			printf(LINENUMBERS_FMT_ARGS);
-			break;
-		default:
-			PANIC();
+/** Expand characters to over-strike form.
+	@param buffer The location to write the result, which must have room for
+		three times @a bytes bytes.
+	@param data The characters to expand.
+	@param bytes The number of characters in @a data.
+	@param underline Whether to over-strike with an underscore rather than
+		with the character itself.
+*/
+static void expandOverstrike(char *buffer, const char *data, size_t bytes, bool underline) {
+	size_t i;
+
+	if (underline) {
+		for (i = 0; i < bytes; i++, buffer += 3) {
+			buffer[0] = '_';
+			buffer[1] = '\010';
+			buffer[2] = data[i];
+		}
+	} else {
+		for (i = 0; i < bytes; i++, buffer += 3) {
+			buffer[0] = data[i];
+			buffer[1] = '\010';
+			buffer[2] = data[i];
+		}
+	}
+}
+
+/** Write changed characters in over-strike form, buffering if necessary.
+	@param data The characters to write.
+	@param bytes The number of characters in @a data.
+	@param underline Whether to over-strike with an underscore (for deleted
+		text) rather than with the character itself (for inserted text).
+
+	Every byte in @a data must be a character on its own, and @a data must not
+	contain newline characters. Without context buffering, the result is
+	written directly into the output buffer.
+*/
+void addOverstrike(const char *data, size_t bytes, bool underline) {
+	static CharBuffer expanded;
+	size_t chunk;
+
+	if (option.context) {
+		expanded.used = 0;
+		VECTOR_ALLOCATE(expanded, 3 * bytes);
+		expandOverstrike(expanded.data, data, bytes, underline);
+		addchars(expanded.data, 3 * bytes, false);
+		return;
+	}
+
+	while (bytes > 0) {
+		if (OUTPUT_BUFFER_SIZE - outputFill < 3)
+			outputSubmit();
+		chunk = (OUTPUT_BUFFER_SIZE - outputFill) / 3;
+		if (chunk > bytes)
+			chunk = bytes;
+		expandOverstrike(outputBuffer + outputFill, data, chunk, underline);
+		outputFill += 3 * chunk;
+		data += chunk;
+		bytes -= chunk;
 	}
 }
 
@@ -207,10 +710,8 @@ void printLineNumbers(int oldLineNumber, int newLineNumber) {
 	The string should not contain newline characters.
 */
 void writeString(const char *string, size_t bytes) {
-	/* Using ignore variable to shut up gcc about the warn_unused_result attribute set on fwrite. */
-	int ignore;
 	if (!option.context) {
-		ignore = fwrite(string, 1, bytes, option.output);
+		outputWrite(string, bytes);
 		return;
 	}
 
@@ -219,13 +720,13 @@ void writeString(const char *string, size_t bytes) {
 		case PRE_BUFFERING:
 		case BUFFERING_INITIAL:
 		case PRE_BUFFERING_INITIAL:
-			VECTOR_ALLOCATE(contextBuffers[bufferIndex], bytes);
-			memcpy(contextBuffers[bufferIndex].data + contextBuffers[bufferIndex].used, string, bytes);
-			contextBuffers[bufferIndex].used += bytes;
+			allocateContext(bytes);
+			memcpy(contextArena.data + contextArena.used, string, bytes);
+			contextArena.used += bytes;
 			break;
 		case PRINTING_AFTER_CONTEXT:
 		case PRINTING_CHANGED:
-			ignore = fwrite(string, 1, bytes, option.output);
+			outputWrite(string, bytes);
 			break;
 		default:
 			PANIC();
@@ -20,7 +20,17 @@
 typedef VECTOR(char, CharBuffer);
 
 void initContextBuffers(void);
+void resetOutputState(void);
+void initOutput(void);
+void initOutputBuffers(int count);
+void outputWrite(const char *data, size_t bytes);
+void outputSubmit(void);
+void outputFlush(void);
+long long getBytesWritten(void);
 void addchar(char c, bool common);
+void addchars(const char *data, size_t bytes, bool common);
+void addOverstrike(const char *data, size_t bytes, bool underline);
+bool skipContext(void);
 void printLineNumbers(int oldLineNumber, int newLineNumber);
 void writeString(const char *string, size_t bytes);
 
@@ -72,15 +72,53 @@ typedef lin ValueType;
 
 typedef VECTOR(ValueType, ValueTypeVector);
 
+/* For --context, the positions in the spooled tokens and whitespace are
+   recorded every SPOOL_CHECKPOINT_INTERVAL tokens, such that the common text
+   between changes can be skipped. */
+#define SPOOL_CHECKPOINT_INTERVAL 256
+
+typedef struct {
+	off_t tokenOffset, whitespaceOffset;
+	/* The number of newlines in the spooled tokens and whitespace before the checkpoint. */
+	lin tokenNewlines, whitespaceNewlines;
+} SpoolCheckpoint;
+
+typedef VECTOR(SpoolCheckpoint, SpoolCheckpointVector);
+
+/* The position of a token in the input text, for --output-format. */
+typedef struct {
+	off_t start, end;
+	/* The lines of the first and the last byte of the token. */
+	lin firstLine, lastLine;
+} TokenPosition;
+
+typedef VECTOR(TokenPosition, TokenPositionVector);
+
 typedef struct {
 	const char *name;
 	Stream *input;
 	ValueTypeVector diffTokens;
 	TempFile *tokens;
 	TempFile *whitespace;
+	/* Spooled diff token values for --window, or NULL. */
+	TempFile *values;
 	int lastPrinted;
 	CharBuffer whitespaceBuffer;
 	bool whitespaceBufferUsed;
+	/* Per token MOVE_* state for --detect-moves, or NULL. */
+	char *moveState;
+	/* Checkpoints for --context, and the number of tokens, pieces of
+	   whitespace and newlines spooled so far. */
+	SpoolCheckpointVector checkpoints;
+	lin spooledTokens, spooledWhitespace, tokenNewlines, whitespaceNewlines;
+	/* The positions of the tokens for --output-format. While reading, the
+	   position in the input text, the line of the last byte read and the
+	   position at which the next token starts. */
+	TokenPositionVector positions;
+	off_t textOffset, tokenOffset;
+	lin textLine, lastByteLine, tokenLine;
+	/* The number of bytes read from the input, for --profile-phases. */
+	off_t inputBytes;
 } InputFile;
 
 typedef struct {
@@ -116,6 +154,7 @@ extern bool UTF8Mode;
 extern CharData charData;
 
 void doDiff(void);
+void printDiff(void);
 
 enum {
 	CAT_OTHER,
@@ -20,10 +20,283 @@
 /* This file has been heavily stripped and slightly modified by G.P. Halkes, 2011. */
 
 /* G.P. Halkes: Additions: */
+#include <string.h>
+#include <time.h>
+#ifdef USE_THREADS
+#include <pthread.h>
+#include <unistd.h>
+#endif
 #include "diff.h"
+#include "phases.h"
 static struct file_data files[2];
-bool minimal;
-bool speed_large_files;
+enum diff_algorithm diff_algorithm;
+lin diff_auto_count[DIFF_FAST + 1];
+enum diff_algorithm diff_auto_choice;
+lin diff_auto_lines;
+lin diff_auto_changes;
+bool diff_auto_aligned;
+/* Settings for the current comparison, derived from DIFF_ALGORITHM.  */
+static bool minimal;
+static bool speed_large_files;
+static lin chunk_size;
+long max_diff_time;
+size_t max_diff_memory;
+lin align_chunk_size;
+lin diff_comparisons;
+lin diff_approximations;
+
+/* Budget bookkeeping. The deadline is set by the first comparison, such that
+   the time limit applies to all comparisons done in a single run. */
+static struct timespec deadline;
+static bool deadline_set;
+static bool time_exhausted;
+static bool comparison_approximated;
+static unsigned budget_checks;
+
+static void set_deadline (void)
+{
+  if (max_diff_time == 0 || deadline_set)
+    return;
+  clock_gettime (CLOCK_MONOTONIC, &deadline);
+  deadline.tv_sec += max_diff_time / 1000;
+  deadline.tv_nsec += (max_diff_time % 1000) * 1000000L;
+  if (deadline.tv_nsec >= 1000000000L)
+    {
+      deadline.tv_sec++;
+      deadline.tv_nsec -= 1000000000L;
+    }
+  deadline_set = true;
+}
+
+/* Check whether the time budget has been used up. Reading the clock is
+   relatively expensive, so it is only done every 64 calls. Once the budget
+   is exhausted, it stays exhausted. */
+static bool out_of_budget (void)
+{
+  struct timespec now;
+
+  if (time_exhausted)
+    {
+      comparison_approximated = true;
+      return true;
+    }
+  if (max_diff_time == 0 || (++budget_checks & 63) != 0)
+    return false;
+
+  clock_gettime (CLOCK_MONOTONIC, &now);
+  if (now.tv_sec > deadline.tv_sec
+      || (now.tv_sec == deadline.tv_sec && now.tv_nsec >= deadline.tv_nsec))
+    {
+      time_exhausted = comparison_approximated = true;
+      return true;
+    }
+  return false;
+}
+
+/* The buffers diff_2_files needs. Instead of allocating and freeing them for
+   every comparison, they are kept around and only grown when a comparison
+   needs more space than any of the previous ones. This saves a lot of
+   allocator and page-fault overhead when many small comparisons are done,
+   as is the case for --diff-input and --match-context.  */
+struct workspace {
+  char *flags;
+  size_t flags_size;
+  lin *lines;             /* undiscarded, realindexes */
+  size_t lines_size;
+  lin *equiv_count;       /* Kept zeroed, see reserve_equiv_count.  */
+  size_t equiv_count_classes;
+  char *discarded;
+  size_t discarded_size;
+  lin *diags;             /* fdiag, bdiag */
+  size_t diags_size;
+  struct small_element *small_elements;
+  size_t small_elements_size;
+  uint64_t *small_columns;  /* Column vectors and match mask.  */
+  size_t small_columns_size;
+};
+static struct workspace workspace;
+
+/* Make sure BUFFER, of which *SIZE bytes are allocated, can hold at least
+   NEEDED bytes. The contents of BUFFER are not preserved.  */
+static void *reserve (void *buffer, size_t *size, size_t needed)
+{
+  if (needed <= *size)
+    return buffer;
+  if (needed < *size * 2)
+    needed = *size * 2;
+  free (buffer);
+  *size = needed;
+  return xmalloc (needed);
+}
+
+/* Make the workspace buffer NAME large enough for COUNT elements.  */
+#define RESERVE(name, count) \
+  ((name) = reserve ((name), &name##_size, (count) * sizeof *(name)))
+
+/* Make sure the equivalence class counters can hold EQUIV_MAX classes for
+   each file. Unlike the other buffers, the counters are kept zeroed between
+   comparisons: discard_confusing_lines only clears the entries it used. With
+   --match-context, EQUIV_MAX is the size of the whole vocabulary, so this
+   keeps the cost of comparing a small range proportional to the range.  */
+static lin *reserve_equiv_count (lin equiv_max)
+{
+  size_t classes = equiv_max;
+
+  if (classes > workspace.equiv_count_classes)
+    {
+      if (classes < workspace.equiv_count_classes * 2)
+	classes = workspace.equiv_count_classes * 2;
+      free (workspace.equiv_count);
+      workspace.equiv_count = zalloc (classes * (2 * sizeof (lin)));
+      workspace.equiv_count_classes = classes;
+    }
+  return workspace.equiv_count;
+}
+/* /Additions. */
+
+/* G.P. Halkes: Additions: */
+/* Compare small subsequences with the bit-parallel LCS algorithm of Allison
+   and Dix (in the formulation of Hyyro), instead of recursing with compareseq.
+   Each column of the LCS table is kept as a bit vector V with one bit per
+   element of X, where bit I is clear iff the LCS length increases between rows
+   I and I + 1. Thus L(I, J), the length of the LCS of the first I elements of
+   X and the first J elements of Y, is I minus the number of set bits below I
+   in column J. All columns are stored, so the script can be traced back.
+
+   Unlike compareseq, which takes O((N + M) * D) time, the kernel takes
+   O(N * M / 64) time regardless of the number of differences D, and always
+   finds a minimal script. It therefore replaces the bottom levels of the
+   recursion, where densely changed regions are split over and over. It is
+   only used for DIFF_BEST: the other algorithms must keep the script found
+   by their heuristics, and compareseq also passes FIND_MINIMAL to the
+   subsequences it splits off without them.
+   SMALL_COMPARE_LIMIT is the maximum number of elements on either side for
+   which it is used, which also bounds the space for the stored columns.  */
+#ifndef SMALL_COMPARE_LIMIT
+#define SMALL_COMPARE_LIMIT 256
+#endif
+
+struct small_element
+{
+  lin value;
+  lin index;
+};
+
+static int compare_small_elements (const void *a, const void *b)
+{
+  const struct small_element *x = a, *y = b;
+  if (x->value != y->value)
+    return x->value < y->value ? -1 : 1;
+  return x->index < y->index ? -1 : x->index > y->index;
+}
+
+static int popcount64 (uint64_t x)
+{
+  x = x - ((x >> 1) & UINT64_C (0x5555555555555555));
+  x = (x & UINT64_C (0x3333333333333333))
+      + ((x >> 2) & UINT64_C (0x3333333333333333));
+  x = (x + (x >> 4)) & UINT64_C (0x0f0f0f0f0f0f0f0f);
+  return (x * UINT64_C (0x0101010101010101)) >> 56;
+}
+
+/* Compute L(I, J) from column vector V.  */
+static lin small_lcs_length (const uint64_t *v, lin i)
+{
+  lin length = i, w;
+
+  for (w = 0; i >= 64; w++, i -= 64)
+    length -= popcount64 (v[w]);
+  if (i > 0)
+    length -= popcount64 (v[w] & ((UINT64_C (1) << i) - 1));
+  return length;
+}
+
+static bool compare_small (const lin *xv, const lin *yv, lin xoff, lin xlim,
+			   lin yoff, lin ylim)
+{
+  lin m = xlim - xoff, n = ylim - yoff;
+  lin words = (m + 63) / 64;
+  struct small_element *sorted;
+  uint64_t *columns, *match;
+  lin i, j, w;
+
+  if (m > SMALL_COMPARE_LIMIT || n > SMALL_COMPARE_LIMIT)
+    return false;
+
+  sorted = RESERVE (workspace.small_elements, m);
+  columns = RESERVE (workspace.small_columns, (n + 2) * words);
+  match = columns + (n + 1) * words;
+
+  for (i = 0; i < m; i++)
+    {
+      sorted[i].value = xv[xoff + i];
+      sorted[i].index = i;
+    }
+  qsort (sorted, m, sizeof *sorted, compare_small_elements);
+
+  for (w = 0; w < words; w++)
+    columns[w] = ~UINT64_C (0);
+
+  for (j = 1; j <= n; j++)
+    {
+      lin value = yv[yoff + j - 1];
+      lin low = 0, high = m;
+      const uint64_t *v = columns + (j - 1) * words;
+      uint64_t *next = columns + j * words;
+      unsigned carry = 0;
+
+      /* Find the first element of X equal to Y[J - 1].  */
+      while (low < high)
+	{
+	  lin mid = low + (high - low) / 2;
+	  if (sorted[mid].value < value)
+	    low = mid + 1;
+	  else
+	    high = mid;
+	}
+      memset (match, 0, words * sizeof *match);
+      for (; low < m && sorted[low].value == value; low++)
+	match[sorted[low].index / 64] |= UINT64_C (1) << (sorted[low].index % 64);
+
+      for (w = 0; w < words; w++)
+	{
+	  uint64_t u = v[w] & match[w];
+	  uint64_t sum = v[w] + u;
+	  unsigned next_carry = sum < u;
+
+	  sum += carry;
+	  next_carry |= sum < carry;
+	  carry = next_carry;
+	  next[w] = sum | (v[w] & ~u);
+	}
+    }
+
+  /* Trace back from the bottom right corner.  */
+  for (i = m, j = n; i > 0 && j > 0; )
+    {
+      if (xv[xoff + i - 1] == yv[yoff + j - 1])
+	{
+	  i--;
+	  j--;
+	}
+      else if (small_lcs_length (columns + j * words, i)
+	       == small_lcs_length (columns + (j - 1) * words, i))
+	{
+	  j--;
+	  files[1].changed[files[1].realindexes[yoff + j]] = 1;
+	}
+      else
+	{
+	  i--;
+	  files[0].changed[files[0].realindexes[xoff + i]] = 1;
+	}
+    }
+  while (i > 0)
+    files[0].changed[files[0].realindexes[xoff + --i]] = 1;
+  while (j > 0)
+    files[1].changed[files[1].realindexes[yoff + --j]] = 1;
+  return true;
+}
 /* /Additions. */
 
 /* The core of the Diff algorithm.  */
@@ -34,6 +307,21 @@ bool speed_large_files;
 #define NOTE_DELETE(c, xoff) (files[0].changed[files[0].realindexes[xoff]] = 1)
 #define NOTE_INSERT(c, yoff) (files[1].changed[files[1].realindexes[yoff]] = 1)
 #define USE_HEURISTIC 1
+#define OUT_OF_BUDGET(ctxt) out_of_budget ()
+#define NOTE_PROGRESS(ctxt, xoff, yoff) report_progress (xoff, yoff)
+#define SMALL_COMPARE(ctxt, xoff, xlim, yoff, ylim) \
+  (minimal \
+   && compare_small ((ctxt)->xvec, (ctxt)->yvec, xoff, xlim, yoff, ylim))
+
+#ifdef USE_THREADS
+/* Whether the environment variable DWDIFF_FORCE_THREADS is set, which makes
+   the search for the midpoint use the helper thread wherever possible, such
+   that the tests can exercise it on a single processor.  */
+static bool force_threads;
+#define FORCE_THREADS force_threads
+#endif
+
+static void report_progress (lin xoff, lin yoff);
 
 #define lint
 #include "diffseq.h"
@@ -60,8 +348,8 @@ discard_confusing_lines (struct file_data filevec[])
   lin *p;
 
   /* Allocate our results.  */
-  p = xmalloc ((filevec[0].buffered_lines + filevec[1].buffered_lines)
-	       * (2 * sizeof *p));
+  p = RESERVE (workspace.lines,
+	       (filevec[0].buffered_lines + filevec[1].buffered_lines) * 2);
   for (f = 0; f < 2; f++)
     {
       filevec[f].undiscarded = p;  p += filevec[f].buffered_lines;
@@ -71,9 +359,9 @@ discard_confusing_lines (struct file_data filevec[])
   /* Set up equiv_count[F][I] as the number of lines in file F
      that fall in equivalence class I.  */
 
-  p = zalloc (filevec[0].equiv_max * (2 * sizeof *p));
+  p = reserve_equiv_count (filevec[0].equiv_max);
   equiv_count[0] = p;
-  equiv_count[1] = p + filevec[0].equiv_max;
+  equiv_count[1] = p + workspace.equiv_count_classes;
 
   for (i = 0; i < filevec[0].buffered_lines; ++i)
     ++equiv_count[0][filevec[0].equivs[i]];
@@ -82,8 +370,10 @@ discard_confusing_lines (struct file_data filevec[])
 
   /* Set up tables of which lines are going to be discarded.  */
 
-  discarded[0] = zalloc (filevec[0].buffered_lines
-			 + filevec[1].buffered_lines);
+  discarded[0] = RESERVE (workspace.discarded, filevec[0].buffered_lines
+					       + filevec[1].buffered_lines);
+  memset (discarded[0], 0,
+	  filevec[0].buffered_lines + filevec[1].buffered_lines);
   discarded[1] = discarded[0] + filevec[0].buffered_lines;
 
   /* Mark to be discarded each line that matches no line of the other file.
@@ -245,8 +535,11 @@ discard_confusing_lines (struct file_data filevec[])
       filevec[f].nondiscarded_lines = j;
     }
 
-  free (discarded[0]);
-  free (equiv_count[0]);
+  /* Leave the counters zeroed for the next comparison.  */
+  for (i = 0; i < filevec[0].buffered_lines; ++i)
+    equiv_count[0][filevec[0].equivs[i]] = 0;
+  for (i = 0; i < filevec[1].buffered_lines; ++i)
+    equiv_count[1][filevec[1].equivs[i]] = 0;
 }
 
 /* Adjust inserts/deletes of identical lines to join changes
@@ -257,10 +550,14 @@ discard_confusing_lines (struct file_data filevec[])
    We are free to choose which identical line is included.
    `compareseq' usually chooses the one at the beginning,
    but usually it is cleaner to consider the following identical line
-   to be the "change".  */
+   to be the "change".
+
+   G.P. Halkes: only the lines from LO up to HI are considered. If HI is not
+   the end of the file, the last line before HI is left unchanged, such that
+   the part from HI onwards can be shifted separately later.  */
 
 static void
-shift_boundaries (struct file_data filevec[])
+shift_boundaries (struct file_data filevec[], lin const lo[], lin const hi[])
 {
   int f;
 
@@ -269,9 +566,9 @@ shift_boundaries (struct file_data filevec[])
       char *changed = filevec[f].changed;
       char *other_changed = filevec[1 - f].changed;
       lin const *equivs = filevec[f].equivs;
-      lin i = 0;
-      lin j = 0;
-      lin i_end = filevec[f].buffered_lines;
+      lin i = lo[f];
+      lin j = lo[1 - f];
+      lin i_end = hi[f] == filevec[f].buffered_lines ? hi[f] : hi[f] - 1;
 
       while (1)
 	{
@@ -309,7 +606,7 @@ shift_boundaries (struct file_data filevec[])
 		 previous unchanged line matches the last changed one.
 		 This merges with previous changed regions.  */
 
-	      while (start && equivs[start - 1] == equivs[i - 1])
+	      while (start > lo[f] && equivs[start - 1] == equivs[i - 1])
 		{
 		  changed[--start] = 1;
 		  changed[--i] = 0;
@@ -356,7 +653,7 @@ shift_boundaries (struct file_data filevec[])
     }
 }
 
-/* Cons an additional entry onto the front of an edit script OLD.
+/* Append an entry to the edit script SCRIPT.
    LINE0 and LINE1 are the first affected lines in the two files (origin 0).
    DELETED is the number of lines deleted here from file 0.
    INSERTED is the number of lines inserted here in file 1.
@@ -364,62 +661,543 @@ shift_boundaries (struct file_data filevec[])
    If DELETED is 0 then LINE0 is the number of the line before
    which the insertion was done; vice versa for INSERTED and LINE1.  */
 
-static struct change *
+static void
 add_change (lin line0, lin line1, lin deleted, lin inserted,
-	    struct change *old)
+	    ChangeVector *script)
 {
-  struct change *new = xmalloc (sizeof *new);
-
-  new->line0 = line0;
-  new->line1 = line1;
-  new->inserted = inserted;
-  new->deleted = deleted;
-  new->link = old;
-  return new;
+  struct change new;
+
+  new.line0 = line0;
+  new.line1 = line1;
+  new.inserted = inserted;
+  new.deleted = deleted;
+  VECTOR_APPEND (*script, new);
 }
 
 /* Scan the tables of which lines are inserted and deleted,
-   producing an edit script in forward order.  */
+   appending an edit script in forward order to SCRIPT.
+   G.P. Halkes: only the lines from LO up to HI are scanned.  */
 
-static struct change *
-build_script (struct file_data const filevec[])
+static void
+build_script (struct file_data const filevec[], lin const lo[], lin const hi[],
+	      ChangeVector *script)
 {
-  struct change *script = 0;
   char *changed0 = filevec[0].changed;
   char *changed1 = filevec[1].changed;
-  lin i0 = filevec[0].buffered_lines, i1 = filevec[1].buffered_lines;
+  lin len0 = hi[0], len1 = hi[1];
+  lin i0 = lo[0], i1 = lo[1];
 
-  /* Note that changedN[-1] does exist, and is 0.  */
+  /* Note that changedN[lenN] does exist, and is 0.  */
 
-  while (i0 >= 0 || i1 >= 0)
+  while (i0 < len0 || i1 < len1)
     {
-      if (changed0[i0 - 1] | changed1[i1 - 1])
+      if (changed0[i0] | changed1[i1])
 	{
 	  lin line0 = i0, line1 = i1;
 
 	  /* Find # lines changed here in each file.  */
-	  while (changed0[i0 - 1]) --i0;
-	  while (changed1[i1 - 1]) --i1;
+	  while (changed0[i0]) ++i0;
+	  while (changed1[i1]) ++i1;
 
 	  /* Record this change.  */
-	  script = add_change (i0, i1, line0 - i0, line1 - i1, script);
+	  add_change (line0, line1, i0 - line0, i1 - line1, script);
 	}
 
       /* We have reached lines in the two files that match each other.  */
-      i0--, i1--;
+      i0++, i1++;
+    }
+}
+
+/* G.P. Halkes: Additions: */
+/* Alignment of large inputs through content-defined chunking. Both token
+   sequences are cut into chunks at positions determined by a rolling hash
+   over the last 64 tokens, such that the same text is cut in the same way in
+   both inputs, regardless of its position. Chunks that occur exactly once in
+   each input are matched by fingerprint. The longest sequence of matches that
+   appears in the same order in both inputs is used as a set of fixed common
+   regions, and only the gaps in between are compared in detail.  */
+
+struct chunk
+{
+  lin start;
+  lin length;
+  uint64_t fingerprint;
+};
+
+/* Entry in the hash table used to match chunks.  */
+struct chunk_match
+{
+  uint64_t fingerprint;
+  lin chunk[2];
+  lin count[2];
+};
+
+#define CHUNK_MIX UINT64_C (0x9E3779B97F4A7C15)
+#define CHUNK_PRIME UINT64_C (0x100000001b3)
+#define CHUNK_BASIS UINT64_C (0xcbf29ce484222325)
+
+/* Cut the LINES tokens in EQUIVS into chunks, of CHUNK_SIZE tokens on
+   average.  Return the number of chunks stored in *RESULT.  */
+
+static lin
+find_chunks (const lin *equivs, lin lines, struct chunk **result)
+{
+  uint64_t mask = chunk_size - 1;
+  lin min_length = chunk_size / 4, max_length = chunk_size * 4;
+  struct chunk *chunks = xmalloc ((lines / min_length + 1) * sizeof *chunks);
+  uint64_t hash = 0, fingerprint = CHUNK_BASIS;
+  lin i, start = 0, count = 0;
+
+  for (i = 0; i < lines; i++)
+    {
+      lin length = i + 1 - start;
+
+      hash = (hash << 1) + ((uint64_t) equivs[i] * CHUNK_MIX >> 32);
+      fingerprint = (fingerprint ^ (uint64_t) equivs[i]) * CHUNK_PRIME;
+      if ((length >= min_length && (hash & mask) == 0)
+          || length >= max_length || i == lines - 1)
+        {
+          chunks[count].start = start;
+          chunks[count].length = length;
+          chunks[count].fingerprint = fingerprint;
+          count++;
+          start = i + 1;
+          fingerprint = CHUNK_BASIS;
+        }
+    }
+  *result = chunks;
+  return count;
+}
+
+/* Find the chunks that occur exactly once in each file, and that are equal.
+   Of those, select the longest sequence that is in the same order in both
+   files.  Store the chunk indices of the selection in ANCHORS[0] and
+   ANCHORS[1], and return its length.  */
+
+static lin
+match_chunks (struct file_data const filevec[], struct chunk *const chunks[2],
+              lin const nchunks[2], lin *anchors[2])
+{
+  struct chunk_match *table;
+  size_t size, mask;
+  lin *pairs, *tails, *prev;
+  lin f, i, npairs = 0, length = 0;
+
+  for (size = 64; size < 2 * (size_t) nchunks[0]; size *= 2)
+    continue;
+  mask = size - 1;
+  table = zalloc (size * sizeof *table);
+
+  for (f = 0; f < 2; f++)
+    for (i = 0; i < nchunks[f]; i++)
+      {
+        uint64_t fingerprint = chunks[f][i].fingerprint;
+        size_t slot;
+
+        for (slot = fingerprint & mask;
+             table[slot].count[0] != 0 && table[slot].fingerprint != fingerprint;
+             slot = (slot + 1) & mask)
+          continue;
+        if (f == 1 && table[slot].count[0] == 0)
+          continue;
+        table[slot].fingerprint = fingerprint;
+        table[slot].chunk[f] = i;
+        table[slot].count[f]++;
+      }
+
+  /* Collect the unique, equal pairs in the order of the old file.  */
+  pairs = xmalloc (2 * nchunks[0] * sizeof *pairs);
+  for (i = 0; i < nchunks[0]; i++)
+    {
+      uint64_t fingerprint = chunks[0][i].fingerprint;
+      struct chunk const *c0 = &chunks[0][i], *c1;
+      size_t slot;
+
+      for (slot = fingerprint & mask; table[slot].fingerprint != fingerprint;
+           slot = (slot + 1) & mask)
+        continue;
+      if (table[slot].count[0] != 1 || table[slot].count[1] != 1)
+        continue;
+      c1 = &chunks[1][table[slot].chunk[1]];
+      if (c0->length != c1->length
+          || memcmp (filevec[0].equivs + c0->start, filevec[1].equivs + c1->start,
+                     c0->length * sizeof *filevec[0].equivs) != 0)
+        continue;
+      pairs[2 * npairs] = i;
+      pairs[2 * npairs + 1] = table[slot].chunk[1];
+      npairs++;
+    }
+  free (table);
+
+  /* Longest increasing subsequence of the new file chunk indices.  TAILS[K]
+     is the pair ending the best subsequence of length K + 1 found so far.  */
+  tails = xmalloc ((npairs + 1) * sizeof *tails);
+  prev = xmalloc ((npairs + 1) * sizeof *prev);
+  for (i = 0; i < npairs; i++)
+    {
+      lin lo = 0, hi = length;
+
+      while (lo < hi)
+        {
+          lin mid = (lo + hi) / 2;
+          if (pairs[2 * tails[mid] + 1] < pairs[2 * i + 1])
+            lo = mid + 1;
+          else
+            hi = mid;
+        }
+      prev[i] = lo > 0 ? tails[lo - 1] : -1;
+      tails[lo] = i;
+      if (lo == length)
+        length++;
+    }
+
+  anchors[0] = xmalloc ((length + 1) * sizeof *anchors[0]);
+  anchors[1] = xmalloc ((length + 1) * sizeof *anchors[1]);
+  for (i = length > 0 ? tails[length - 1] : -1, f = length; i >= 0; i = prev[i])
+    {
+      f--;
+      anchors[0][f] = pairs[2 * i];
+      anchors[1][f] = pairs[2 * i + 1];
+    }
+
+  free (tails);
+  free (prev);
+  free (pairs);
+  return length;
+}
+
+/* Compare the files using chunk alignment, if enabled and worthwhile.
+   Return false if the caller should compare the files as a whole.  */
+
+static bool
+compare_aligned (struct file_data filevec[], struct context *ctxt)
+{
+  struct chunk *chunks[2];
+  lin nchunks[2];
+  lin *anchors[2];
+  lin nanchors, f, k;
+  lin next[2] = { 0, 0 };
+
+  if (chunk_size == 0
+      || filevec[0].buffered_lines < 4 * chunk_size
+      || filevec[1].buffered_lines < 4 * chunk_size)
+    return false;
+
+  for (f = 0; f < 2; f++)
+    nchunks[f] = find_chunks (filevec[f].equivs, filevec[f].buffered_lines,
+                              &chunks[f]);
+  nanchors = match_chunks (filevec, chunks, nchunks, anchors);
+
+  if (nanchors != 0)
+    {
+      /* NEXT[F] is the first undiscarded line after the previous anchor.  */
+      for (k = 0; k <= nanchors; k++)
+        {
+          lin end[2];
+
+          for (f = 0; f < 2; f++)
+            {
+              lin gap_end = k < nanchors ? chunks[f][anchors[f][k]].start
+                                         : filevec[f].buffered_lines;
+
+              for (end[f] = next[f];
+                   end[f] < filevec[f].nondiscarded_lines
+                   && filevec[f].realindexes[end[f]] < gap_end;
+                   end[f]++)
+                continue;
+            }
+
+          compareseq (next[0], end[0], next[1], end[1], minimal, ctxt);
+          if (k == nanchors)
+            break;
+
+          for (f = 0; f < 2; f++)
+            {
+              struct chunk const *c = &chunks[f][anchors[f][k]];
+
+              /* Lines in the anchor may have been discarded as confusing,
+                 but they are common by definition.  */
+              memset (filevec[f].changed + c->start, 0, c->length);
+              for (next[f] = end[f];
+                   next[f] < filevec[f].nondiscarded_lines
+                   && filevec[f].realindexes[next[f]] < c->start + c->length;
+                   next[f]++)
+                continue;
+            }
+          report_progress (next[0], next[1]);
+        }
+    }
+
+  for (f = 0; f < 2; f++)
+    {
+      free (chunks[f]);
+      free (anchors[f]);
+    }
+  return nanchors != 0;
+}
+/* /Additions. */
+
+/* G.P. Halkes: Additions: */
+/* Reporting of the edit script while the comparison is still running. Once
+   compareseq has recorded the fate of all lines before a point on the path,
+   the part of the edit script before that point is shifted, built and handed
+   to DIFF_PARTIAL_SCRIPT, such that output can start long before a large
+   comparison is complete.  */
+
+void (*diff_partial_script) (ChangeVector *script);
+
+/* Minimum number of lines (of both files together) in a partial script.  */
+#define PARTIAL_SCRIPT_LINES 4096
+
+/* Whether the current comparison reports partial scripts, and whether
+   DIFF_PARTIAL_SCRIPT is running.  */
+static bool partial_active;
+static bool partial_reporting;
+/* Lines of both files up to which the script has been reported.  */
+static lin partial_done[2];
+static ChangeVector partial_script;
+/* Buffers for the comparisons done by DIFF_PARTIAL_SCRIPT.  */
+static struct workspace partial_workspace;
+
+/* Report the edit script up to lines XOFF and YOFF of the undiscarded lines,
+   if that is worthwhile.  */
+
+static void
+report_progress (lin xoff, lin yoff)
+{
+  lin offset[2] = { xoff, yoff };
+  lin point[2];
+  struct file_data saved_files[2];
+  struct workspace saved_workspace;
+  bool saved_approximated, saved_minimal, saved_speed_large_files;
+  lin saved_chunk_size;
+  int f;
+
+  if (!partial_active)
+    return;
+
+  /* The discarded lines between the last undiscarded line before OFFSET and
+     the one at OFFSET are changed, so the point is just after the former.  */
+  for (f = 0; f < 2; f++)
+    point[f] = offset[f] == 0 ? 0 : files[f].realindexes[offset[f] - 1] + 1;
+  if (point[0] + point[1] - partial_done[0] - partial_done[1]
+      < PARTIAL_SCRIPT_LINES)
+    return;
+
+  /* A change that ends at POINT may still grow. Stop between two unchanged
+     lines instead, which shift_boundaries then leaves alone.  */
+  for (f = 0; f < 2; f++)
+    {
+      if (point[f] < 2 || files[f].changed[point[f] - 1]
+	  || files[f].changed[point[f] - 2])
+	return;
+      point[f]--;
     }
 
-  return script;
+  shift_boundaries (files, partial_done, point);
+  partial_script.used = 0;
+  build_script (files, partial_done, point, &partial_script);
+  partial_done[0] = point[0];
+  partial_done[1] = point[1];
+
+  /* Comparisons done by DIFF_PARTIAL_SCRIPT get their own buffers, except
+     for the equivalence counters, which are not in use at this point.  */
+  saved_files[0] = files[0];
+  saved_files[1] = files[1];
+  saved_approximated = comparison_approximated;
+  saved_minimal = minimal;
+  saved_speed_large_files = speed_large_files;
+  saved_chunk_size = chunk_size;
+  saved_workspace = workspace;
+  workspace = partial_workspace;
+  workspace.equiv_count = saved_workspace.equiv_count;
+  workspace.equiv_count_classes = saved_workspace.equiv_count_classes;
+  partial_reporting = true;
+
+  diff_partial_script (&partial_script);
+
+  partial_reporting = false;
+  partial_active = true;
+  saved_workspace.equiv_count = workspace.equiv_count;
+  saved_workspace.equiv_count_classes = workspace.equiv_count_classes;
+  partial_workspace = workspace;
+  workspace = saved_workspace;
+  comparison_approximated = saved_approximated;
+  minimal = saved_minimal;
+  speed_large_files = saved_speed_large_files;
+  chunk_size = saved_chunk_size;
+  files[0] = saved_files[0];
+  files[1] = saved_files[1];
 }
+/* /Additions. */
 
-/* Report the differences of two files.  */
-struct change *diff_2_files (struct comparison *cmp)
+/* G.P. Halkes: Additions: */
+/* Estimate the number of bytes diff_2_files needs for comparing CMP,
+   excluding the change flags.  */
+
+static size_t
+workspace_size (struct comparison const *cmp)
 {
-  struct change *script;
+  size_t lines = cmp->file[0].buffered_lines + cmp->file[1].buffered_lines;
+
+  return lines * (2 * sizeof (lin))        /* undiscarded, realindexes */
+         + cmp->file[0].equiv_max * (2 * sizeof (lin)) /* equiv_count */
+         + lines                            /* discarded */
+         + (lines + 3) * (2 * sizeof (lin)) /* fdiag, bdiag */
+         + SMALL_COMPARE_LIMIT * sizeof (struct small_element)
+         + (SMALL_COMPARE_LIMIT + 2) * ((SMALL_COMPARE_LIMIT + 63) / 64)
+           * sizeof (uint64_t);             /* compare_small */
+}
+
+/* Find the part of the two files between their common prefix and their
+   common suffix. BOUNDS is set to the start and end in the first file,
+   followed by the start and end in the second file.  */
+
+static void
+common_ends (struct file_data const filevec[], lin bounds[4])
+{
+  lin xoff = 0, yoff = 0;
+  lin xlim = filevec[0].buffered_lines, ylim = filevec[1].buffered_lines;
+
+  while (xoff < xlim && yoff < ylim
+         && filevec[0].equivs[xoff] == filevec[1].equivs[yoff])
+    xoff++, yoff++;
+  while (xoff < xlim && yoff < ylim
+         && filevec[0].equivs[xlim - 1] == filevec[1].equivs[ylim - 1])
+    xlim--, ylim--;
+
+  bounds[0] = xoff;
+  bounds[1] = xlim;
+  bounds[2] = yoff;
+  bounds[3] = ylim;
+}
 
+/* Mark everything between the common prefix and the common suffix of the
+   two files as changed.  This is the answer of last resort when the
+   comparison may not use the memory a real analysis needs.  */
+
+static void
+replace_middle (struct file_data filevec[])
+{
+  lin bounds[4];
+
+  common_ends (filevec, bounds);
+  memset (filevec[0].changed + bounds[0], 1, bounds[1] - bounds[0]);
+  memset (filevec[1].changed + bounds[2], 1, bounds[3] - bounds[2]);
+}
+/* /Additions. */
+
+/* G.P. Halkes: Additions: */
+/* Automatic selection of the algorithm. What matters most for the cost of a
+   comparison is the number of lines between the common start and end of the
+   files, and the number of changes in there. The latter is estimated by
+   comparing how often each equivalence class occurs in both files: every
+   line that is in one file but not in the other shows up in the difference,
+   so the sum of the differences is a lower bound on the number of changed
+   lines. Lines that have moved are not counted, but those rarely dominate
+   the cost.  */
+
+/* Comparisons for which the number of lines times the estimated number of
+   changes is at most this much are cheap enough to find the minimal set of
+   changes.  */
+#define AUTO_BEST_COST ((lin) 1 << 24)
+/* Comparisons of more than this many lines in which more than
+   AUTO_DENSE_PERCENT of the lines has changed use the heuristics for large
+   files.  */
+#define AUTO_DENSE_LINES 16384
+#define AUTO_DENSE_PERCENT 20
+/* Comparisons of at least this many lines, with fewer changes, are first
+   aligned on chunks if the user didn't ask for a chunk size.  */
+#define AUTO_ALIGN_LINES (1 << 20)
+#define AUTO_ALIGN_CHUNK_SIZE 1024
+
+/* Estimate the number of changes in the part of FILEVEC given by BOUNDS,
+   see common_ends.  The estimate is the number of deleted plus inserted
+   lines: every line of a class that occurs more often in one file than in
+   the other must be deleted or inserted, so it is a lower bound.  */
+
+static lin
+estimate_changes (struct file_data const filevec[], lin const bounds[4])
+{
+  lin *count[2];
+  lin i, changes = 0;
+
+  /* Use the counters of discard_confusing_lines, and leave them zeroed.  */
+  count[0] = reserve_equiv_count (filevec[0].equiv_max);
+  count[1] = count[0] + workspace.equiv_count_classes;
+
+  for (i = bounds[0]; i < bounds[1]; i++)
+    count[0][filevec[0].equivs[i]]++;
+  for (i = bounds[2]; i < bounds[3]; i++)
+    count[1][filevec[1].equivs[i]]++;
+
+  /* Add the difference for each class once, by clearing the counters when
+     they have been used.  */
+  for (i = bounds[0]; i < bounds[1]; i++)
+    {
+      lin e = filevec[0].equivs[i];
+      changes += count[0][e] > count[1][e] ? count[0][e] - count[1][e]
+                                           : count[1][e] - count[0][e];
+      count[0][e] = count[1][e] = 0;
+    }
+  for (i = bounds[2]; i < bounds[3]; i++)
+    {
+      lin e = filevec[1].equivs[i];
+      changes += count[1][e];
+      count[1][e] = 0;
+    }
+  return changes;
+}
+
+/* Choose the algorithm for comparing FILEVEC, and set CHUNK_SIZE.  */
+
+static enum diff_algorithm
+choose_algorithm (struct file_data const filevec[])
+{
+  enum diff_algorithm choice;
+  lin bounds[4];
+  lin lines, changes;
+
+  chunk_size = align_chunk_size;
+  if (diff_algorithm != DIFF_AUTO)
+    return diff_algorithm;
+
+  common_ends (filevec, bounds);
+  lines = bounds[1] - bounds[0] + bounds[3] - bounds[2];
+  changes = estimate_changes (filevec, bounds);
+
+  if (changes == 0 || lines <= AUTO_BEST_COST / changes)
+    choice = DIFF_BEST;
+  else if (lines > AUTO_DENSE_LINES
+           && changes > lines / 100 * AUTO_DENSE_PERCENT)
+    choice = DIFF_FAST;
+  else
+    {
+      choice = DIFF_NORMAL;
+      if (chunk_size == 0 && lines >= AUTO_ALIGN_LINES)
+        chunk_size = AUTO_ALIGN_CHUNK_SIZE;
+    }
+
+  diff_auto_count[choice]++;
+  if (lines > diff_auto_lines)
+    {
+      diff_auto_choice = choice;
+      diff_auto_lines = lines;
+      diff_auto_changes = changes;
+      diff_auto_aligned = chunk_size != 0;
+    }
+  return choice;
+}
+/* /Additions. */
+
+/* Report the differences of two files, by appending the edit script to
+   SCRIPT.  */
+void diff_2_files (struct comparison *cmp, ChangeVector *script)
+{
   struct context ctxt;
   lin diags;
   lin too_expensive;
+  lin start[2], end[2];
 
   /* Allocate vectors for the results of comparison:
      a flag for each line of each file, saying whether that line
@@ -427,57 +1205,99 @@ struct change *diff_2_files (struct comparison *cmp)
      Allocate an extra element, always 0, at each end of each vector.  */
 
   size_t s = cmp->file[0].buffered_lines + cmp->file[1].buffered_lines + 4;
-  char *flag_space = zalloc (s);
+  char *flag_space = RESERVE (workspace.flags, s);
+  memset (flag_space, 0, s);
   cmp->file[0].changed = flag_space + 1;
   cmp->file[1].changed = flag_space + cmp->file[0].buffered_lines + 3;
 
-  /* Some lines are obviously insertions or deletions
-     because they don't match anything.  Detect them now, and
-     avoid even thinking about them in the main comparison algorithm.  */
-
-  discard_confusing_lines (cmp->file);
-
-  /* Now do the main comparison algorithm, considering just the
-     undiscarded lines.  */
-
-  ctxt.xvec = cmp->file[0].undiscarded;
-  ctxt.yvec = cmp->file[1].undiscarded;
-  diags = (cmp->file[0].nondiscarded_lines
-	   + cmp->file[1].nondiscarded_lines + 3);
-  ctxt.fdiag = xmalloc (diags * (2 * sizeof *ctxt.fdiag));
-  ctxt.bdiag = ctxt.fdiag + diags;
-  ctxt.fdiag += cmp->file[1].nondiscarded_lines + 1;
-  ctxt.bdiag += cmp->file[1].nondiscarded_lines + 1;
-
-  ctxt.heuristic = speed_large_files;
-
-  /* Set TOO_EXPENSIVE to be approximate square root of input size,
-     bounded below by 256.  */
-  too_expensive = 1;
-  for (;  diags != 0;  diags >>= 2)
-    too_expensive <<= 1;
-  ctxt.too_expensive = MAX (256, too_expensive);
-
-  files[0] = cmp->file[0];
-  files[1] = cmp->file[1];
-
-  compareseq (0, cmp->file[0].nondiscarded_lines,
-	      0, cmp->file[1].nondiscarded_lines, minimal, &ctxt);
+  set_deadline ();
+#ifdef USE_THREADS
+  force_threads = getenv ("DWDIFF_FORCE_THREADS") != NULL;
+#endif
+  diff_comparisons++;
+  comparison_approximated = false;
+  partial_active = diff_partial_script != NULL && !partial_reporting;
+  if (partial_active)
+    partial_done[0] = partial_done[1] = 0;
+
+  /* If the budget does not allow a real analysis, settle for reporting
+     everything between the common prefix and suffix as changed.  */
+
+  if (time_exhausted
+      || (max_diff_memory != 0 && workspace_size (cmp) > max_diff_memory))
+    {
+      replace_middle (cmp->file);
+      comparison_approximated = true;
+    }
+  else
+    {
+      enum diff_algorithm algorithm = choose_algorithm (cmp->file);
+
+      minimal = algorithm == DIFF_BEST;
+      speed_large_files = algorithm == DIFF_FAST;
+
+      /* Some lines are obviously insertions or deletions
+	 because they don't match anything.  Detect them now, and
+	 avoid even thinking about them in the main comparison algorithm.  */
+
+      phaseStart (PHASE_DISCARD);
+      discard_confusing_lines (cmp->file);
+      phaseEnd (PHASE_DISCARD);
+
+      /* Now do the main comparison algorithm, considering just the
+	 undiscarded lines.  */
+
+      ctxt.xvec = cmp->file[0].undiscarded;
+      ctxt.yvec = cmp->file[1].undiscarded;
+      diags = (cmp->file[0].nondiscarded_lines
+	       + cmp->file[1].nondiscarded_lines + 3);
+      ctxt.fdiag = RESERVE (workspace.diags, diags * 2);
+      ctxt.bdiag = ctxt.fdiag + diags;
+      ctxt.fdiag += cmp->file[1].nondiscarded_lines + 1;
+      ctxt.bdiag += cmp->file[1].nondiscarded_lines + 1;
+
+      ctxt.heuristic = speed_large_files;
+
+      /* Set TOO_EXPENSIVE to be approximate square root of input size,
+	 bounded below by 256.  */
+      too_expensive = 1;
+      for (;  diags != 0;  diags >>= 2)
+	too_expensive <<= 1;
+      ctxt.too_expensive = MAX (256, too_expensive);
+
+      files[0] = cmp->file[0];
+      files[1] = cmp->file[1];
+
+      phaseStart (PHASE_COMPARE);
+      if (!compare_aligned (cmp->file, &ctxt))
+	compareseq (0, cmp->file[0].nondiscarded_lines,
+		    0, cmp->file[1].nondiscarded_lines, minimal, &ctxt);
+      phaseEnd (PHASE_COMPARE);
+    }
 
-  free (ctxt.fdiag - (cmp->file[1].nondiscarded_lines + 1));
+  if (comparison_approximated)
+    diff_approximations++;
 
   /* Modify the results slightly to make them prettier
      in cases where that can validly be done.  */
 
-  shift_boundaries (cmp->file);
-
-  /* Get the results of comparison in the form of a chain
-     of `struct change's -- an edit script.  */
+  if (!partial_active)
+    start[0] = start[1] = 0;
+  else
+    {
+      start[0] = partial_done[0];
+      start[1] = partial_done[1];
+      partial_active = false;
+    }
+  end[0] = cmp->file[0].buffered_lines;
+  end[1] = cmp->file[1].buffered_lines;
 
-  script = build_script (cmp->file);
+  phaseStart (PHASE_SHIFT);
+  shift_boundaries (cmp->file, start, end);
+  phaseEnd (PHASE_SHIFT);
 
-  free (cmp->file[0].undiscarded);
-  free (flag_space);
+  /* Get the results of comparison in the form of an array
+     of `struct change's -- an edit script.  */
 
-  return script;
+  build_script (cmp->file, start, end, script);
 }
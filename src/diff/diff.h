@@ -47,15 +47,43 @@ static_assert(sizeof (lin) <= sizeof (long int));
 #define zalloc safe_calloc
 
 
-/* Use heuristics for better speed with large files with a small
-   density of changes.  */
-extern bool speed_large_files;
-
-/* Don't discard lines.  This makes things slower (sometimes much
-   slower) but will find a guaranteed minimal set of changes.  */
-extern bool minimal;
-
-/* The result of comparison is an "edit script": a chain of `struct change'.
+/* The algorithms that can be used for a comparison. DIFF_BEST doesn't
+   discard lines. This makes things slower (sometimes much slower) but will
+   find a guaranteed minimal set of changes. DIFF_FAST uses heuristics for
+   better speed with large files with many changes. DIFF_AUTO chooses one of
+   the others for each comparison, based on its size and an estimate of the
+   number of changes.  */
+enum diff_algorithm { DIFF_AUTO, DIFF_BEST, DIFF_NORMAL, DIFF_FAST };
+extern enum diff_algorithm diff_algorithm;
+
+/* For DIFF_AUTO: the number of comparisons each algorithm was chosen for,
+   and for the largest comparison the choice made, the number of lines it
+   compared (excluding the common start and end), the lower bound on the
+   number of deleted plus inserted lines on which the choice was based, and
+   whether chunk alignment was used.  */
+extern lin diff_auto_count[DIFF_FAST + 1];
+extern enum diff_algorithm diff_auto_choice;
+extern lin diff_auto_lines;
+extern lin diff_auto_changes;
+extern bool diff_auto_aligned;
+
+/* Limits on the time (in milliseconds) that may be spent on all comparisons
+   together, and on the memory (in bytes) a single comparison may use. Zero
+   means no limit. When a limit is hit, the remaining work is done in a crude
+   but fast way.  */
+extern long max_diff_time;
+extern size_t max_diff_memory;
+
+/* Average size, in tokens, of the chunks used to align large inputs before
+   comparing them. Must be a power of two. Zero disables alignment.  */
+extern lin align_chunk_size;
+
+/* The number of comparisons done, and the number of those for which the
+   result was approximated because a limit was hit.  */
+extern lin diff_comparisons;
+extern lin diff_approximations;
+
+/* The result of comparison is an "edit script": a list of `struct change'.
    Each `struct change' represents one place where some lines are deleted
    and some are inserted.
 
@@ -68,14 +96,15 @@ extern bool minimal;
 
 struct change
 {
-  struct change *link;		/* Previous or next edit command  */
   lin inserted;			/* # lines of file 1 changed here.  */
   lin deleted;			/* # lines of file 0 changed here.  */
   lin line0;			/* Line number of 1st deleted line.  */
   lin line1;			/* Line number of 1st inserted line.  */
-  bool ignore;			/* Flag used in context.c.  */
 };
 
+/* The edit script is stored as an array, in forward order.  */
+typedef VECTOR(struct change, ChangeVector);
+
 /* Structures that describe the input files.  */
 
 /* Data on one input file being compared.  */
@@ -121,6 +150,13 @@ struct comparison
     struct comparison const *parent;  /* parent, if a recursive comparison */
   };
 
-struct change *diff_2_files(struct comparison *cmp);
+void diff_2_files(struct comparison *cmp, ChangeVector *script);
+
+/* If not NULL, diff_2_files calls this with each part of the edit script
+   that has become final while the comparison is still running, in file
+   order. Only the remainder is appended to the script passed to diff_2_files.
+   The function may itself call diff_2_files, which then does not report
+   partial scripts.  */
+extern void (*diff_partial_script) (ChangeVector *script);
 
 #endif
@@ -51,6 +51,29 @@
      NOTE_INSERT(ctxt, yoff) Record the insertion of the object yvec[yoff].
      EARLY_ABORT(ctxt)       (Optional) A boolean expression that triggers an
                              early abort of the computation.
+     OUT_OF_BUDGET(ctxt)     (Optional) A boolean expression that, once true,
+                             makes the computation degrade instead of abort:
+                             the midpoint search returns its best guess so
+                             far, and subsequences that have not been split
+                             yet are reported as replaced as a whole.
+     SMALL_COMPARE(ctxt, xoff, xlim, yoff, ylim)
+                             (Optional) A boolean expression that, if true,
+                             has compared the given subsequences itself and
+                             recorded all deletions and insertions.
+                             Typically used for a specialized algorithm for
+                             small subsequences.
+     NOTE_PROGRESS(ctxt, xoff, yoff)
+                             (Optional) Called with increasing offsets when
+                             the fate of all objects before xvec[xoff] and
+                             yvec[yoff] has been recorded.
+     USE_THREADS             (Optional) Define to do the forward and backward
+                             searches for the midpoint of large subsequences
+                             on two threads.  Requires <pthread.h> and
+                             <unistd.h>.
+     FORCE_THREADS           (Optional) A boolean expression that, if true,
+                             makes USE_THREADS use the helper thread for all
+                             subsequences and cost levels, also on a single
+                             processor.  For testing the threaded search.
      USE_HEURISTIC           (Optional) Define if you want to support the
                              heuristic for large vectors.
    It is also possible to use this file with abstract arrays.  In this case,
@@ -76,6 +99,26 @@
 # define EARLY_ABORT(ctxt) false
 #endif
 
+/* Default to an unlimited budget.  */
+#ifndef OUT_OF_BUDGET
+# define OUT_OF_BUDGET(ctxt) false
+#endif
+
+/* Default to using compareseq for all subsequences.  */
+#ifndef SMALL_COMPARE
+# define SMALL_COMPARE(ctxt, xoff, xlim, yoff, ylim) false
+#endif
+
+/* Default to not reporting progress.  */
+#ifndef NOTE_PROGRESS
+# define NOTE_PROGRESS(ctxt, xoff, yoff) ((void) 0)
+#endif
+
+/* Default to using the helper thread only where it pays off.  */
+#ifndef FORCE_THREADS
+# define FORCE_THREADS false
+#endif
+
 /* Use this to suppress gcc's `...may be used before initialized' warnings.
    Beware: The Code argument must not contain commas.  */
 #ifndef IF_LINT
@@ -147,6 +190,205 @@ struct partition
 };
 
 
+/* Extend the top-down search by an edit step in each of the diagonals
+   FMIN..FMAX (in steps of 2).  If CHECK, stop at the first diagonal that
+   overlaps the bottom-up search in BMIN..BMAX, record the midpoint in PART
+   and return true.  Set *BIG_SNAKE if a long snake was followed.  */
+
+static bool
+diag_forward (OFFSET xlim, OFFSET ylim, OFFSET fmin, OFFSET fmax,
+              bool check, OFFSET bmin, OFFSET bmax, struct partition *part,
+              bool *big_snake, struct context *ctxt)
+{
+  OFFSET *const fd = ctxt->fdiag;
+  OFFSET const *const bd = ctxt->bdiag;
+#ifdef ELEMENT
+  ELEMENT const *const xv = ctxt->xvec;
+  ELEMENT const *const yv = ctxt->yvec;
+  #define XREF_YREF_EQUAL(x,y)  EQUAL (xv[x], yv[y])
+#else
+  #define XREF_YREF_EQUAL(x,y)  XVECREF_YVECREF_EQUAL (ctxt, x, y)
+#endif
+  OFFSET d;
+
+  for (d = fmax; d >= fmin; d -= 2)
+    {
+      OFFSET x;
+      OFFSET y;
+      OFFSET tlo = fd[d - 1];
+      OFFSET thi = fd[d + 1];
+      OFFSET x0 = tlo < thi ? thi : tlo + 1;
+
+      for (x = x0, y = x0 - d;
+           x < xlim && y < ylim && XREF_YREF_EQUAL (x, y);
+           x++, y++)
+        continue;
+      if (x - x0 > SNAKE_LIMIT)
+        *big_snake = true;
+      fd[d] = x;
+      if (check && bmin <= d && d <= bmax && bd[d] <= x)
+        {
+          part->xmid = x;
+          part->ymid = y;
+          part->lo_minimal = part->hi_minimal = true;
+          return true;
+        }
+    }
+  return false;
+  #undef XREF_YREF_EQUAL
+}
+
+/* Likewise for the bottom-up search in the diagonals BMIN..BMAX, which
+   overlaps the top-down search in FMIN..FMAX.  */
+
+static bool
+diag_backward (OFFSET xoff, OFFSET yoff, OFFSET bmin, OFFSET bmax,
+               bool check, OFFSET fmin, OFFSET fmax, struct partition *part,
+               bool *big_snake, struct context *ctxt)
+{
+  OFFSET const *const fd = ctxt->fdiag;
+  OFFSET *const bd = ctxt->bdiag;
+#ifdef ELEMENT
+  ELEMENT const *const xv = ctxt->xvec;
+  ELEMENT const *const yv = ctxt->yvec;
+  #define XREF_YREF_EQUAL(x,y)  EQUAL (xv[x], yv[y])
+#else
+  #define XREF_YREF_EQUAL(x,y)  XVECREF_YVECREF_EQUAL (ctxt, x, y)
+#endif
+  OFFSET d;
+
+  for (d = bmax; d >= bmin; d -= 2)
+    {
+      OFFSET x;
+      OFFSET y;
+      OFFSET tlo = bd[d - 1];
+      OFFSET thi = bd[d + 1];
+      OFFSET x0 = tlo < thi ? tlo : thi - 1;
+
+      for (x = x0, y = x0 - d;
+           xoff < x && yoff < y && XREF_YREF_EQUAL (x - 1, y - 1);
+           x--, y--)
+        continue;
+      if (x0 - x > SNAKE_LIMIT)
+        *big_snake = true;
+      bd[d] = x;
+      if (check && fmin <= d && d <= fmax && x <= fd[d])
+        {
+          part->xmid = x;
+          part->ymid = y;
+          part->lo_minimal = part->hi_minimal = true;
+          return true;
+        }
+    }
+  return false;
+  #undef XREF_YREF_EQUAL
+}
+
+#ifdef USE_THREADS
+/* The forward and backward searches of a single cost level only read and
+   write their own vector, except for the overlap check.  For large
+   subproblems, the backward search is therefore handed to a helper thread
+   while the calling thread does the forward search.  The overlap check is
+   arranged such that the result is identical to the sequential search.
+
+   Subproblems with fewer elements than PARALLEL_MIN_SIZE are always searched
+   sequentially, as are cost levels with fewer than PARALLEL_MIN_DIAGONALS
+   active diagonals: for those, handing over the work costs more than it
+   saves.  */
+#define PARALLEL_MIN_SIZE 16384
+#define PARALLEL_MIN_DIAGONALS 2048
+
+static pthread_mutex_t sweep_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t sweep_cond = PTHREAD_COND_INITIALIZER;
+static enum { SWEEP_IDLE, SWEEP_RUNNING, SWEEP_UNAVAILABLE } sweep_thread_state;
+static struct
+{
+  OFFSET xoff, yoff, bmin, bmax;
+  struct context *ctxt;
+  bool big_snake;
+  bool pending;
+} sweep_job;
+
+static void *
+sweep_thread (void *arg)
+{
+  (void) arg;
+
+  pthread_mutex_lock (&sweep_lock);
+  for (;;)
+    {
+      while (!sweep_job.pending)
+        pthread_cond_wait (&sweep_cond, &sweep_lock);
+      pthread_mutex_unlock (&sweep_lock);
+
+      sweep_job.big_snake = false;
+      diag_backward (sweep_job.xoff, sweep_job.yoff, sweep_job.bmin,
+                     sweep_job.bmax, false, 0, 0, NULL,
+                     &sweep_job.big_snake, sweep_job.ctxt);
+
+      pthread_mutex_lock (&sweep_lock);
+      sweep_job.pending = false;
+      pthread_cond_broadcast (&sweep_cond);
+    }
+  return NULL;
+}
+
+/* Start the bottom-up search of one cost level on the helper thread.
+   Return false if no helper thread is available.  */
+
+static bool
+start_backward_sweep (OFFSET xoff, OFFSET yoff, OFFSET bmin, OFFSET bmax,
+                      struct context *ctxt)
+{
+  if (sweep_thread_state == SWEEP_UNAVAILABLE)
+    return false;
+  if (sweep_thread_state == SWEEP_IDLE)
+    {
+      pthread_t thread;
+
+#ifdef _SC_NPROCESSORS_ONLN
+      /* With a single processor, the helper thread only adds overhead.  */
+      if (!FORCE_THREADS && sysconf (_SC_NPROCESSORS_ONLN) < 2)
+        {
+          sweep_thread_state = SWEEP_UNAVAILABLE;
+          return false;
+        }
+#endif
+      if (pthread_create (&thread, NULL, sweep_thread, NULL) != 0)
+        {
+          sweep_thread_state = SWEEP_UNAVAILABLE;
+          return false;
+        }
+      pthread_detach (thread);
+      sweep_thread_state = SWEEP_RUNNING;
+    }
+
+  pthread_mutex_lock (&sweep_lock);
+  sweep_job.xoff = xoff;
+  sweep_job.yoff = yoff;
+  sweep_job.bmin = bmin;
+  sweep_job.bmax = bmax;
+  sweep_job.ctxt = ctxt;
+  sweep_job.pending = true;
+  pthread_cond_broadcast (&sweep_cond);
+  pthread_mutex_unlock (&sweep_lock);
+  return true;
+}
+
+/* Wait for the helper thread to finish the bottom-up search.  */
+
+static void
+finish_backward_sweep (bool *big_snake)
+{
+  pthread_mutex_lock (&sweep_lock);
+  while (sweep_job.pending)
+    pthread_cond_wait (&sweep_cond, &sweep_lock);
+  pthread_mutex_unlock (&sweep_lock);
+  if (sweep_job.big_snake)
+    *big_snake = true;
+}
+#endif
+
 /* Find the midpoint of the shortest edit script for a specified portion
    of the two vectors.
 
@@ -198,6 +440,10 @@ diag (OFFSET xoff, OFFSET xlim, OFFSET yoff, OFFSET ylim, bool find_minimal,
   OFFSET c;                     /* Cost. */
   bool odd = (fmid - bmid) & 1; /* True if southeast corner is on an odd
                                    diagonal with respect to the northwest. */
+#ifdef USE_THREADS
+  bool parallel = FORCE_THREADS
+                  || (xlim - xoff) + (ylim - yoff) >= PARALLEL_MIN_SIZE;
+#endif
 
   fd[fmid] = xoff;
   bd[bmid] = xlim;
@@ -206,6 +452,8 @@ diag (OFFSET xoff, OFFSET xlim, OFFSET yoff, OFFSET ylim, bool find_minimal,
     {
       OFFSET d;                 /* Active diagonal. */
       bool big_snake = false;
+      OFFSET prev_bmin = bmin;
+      OFFSET prev_bmax = bmax;
 
       /* Extend the top-down search by an edit step in each diagonal. */
       if (fmin > dmin)
@@ -216,64 +464,76 @@ diag (OFFSET xoff, OFFSET xlim, OFFSET yoff, OFFSET ylim, bool find_minimal,
         fd[++fmax + 1] = -1;
       else
         --fmax;
-      for (d = fmax; d >= fmin; d -= 2)
+
+#ifdef USE_THREADS
+      /* The top-down search only looks at the diagonals of the bottom-up
+         search of the previous cost level that have the other parity than
+         the ones written by the bottom-up search of this level.  Thus both
+         can run concurrently.  The bottom-up overlap check however needs
+         the top-down results of this level, so it is done afterwards.  */
+      if (parallel
+          && (FORCE_THREADS || fmax - fmin >= PARALLEL_MIN_DIAGONALS))
         {
-          OFFSET x;
-          OFFSET y;
-          OFFSET tlo = fd[d - 1];
-          OFFSET thi = fd[d + 1];
-          OFFSET x0 = tlo < thi ? thi : tlo + 1;
-
-          for (x = x0, y = x0 - d;
-               x < xlim && y < ylim && XREF_YREF_EQUAL (x, y);
-               x++, y++)
-            continue;
-          if (x - x0 > SNAKE_LIMIT)
-            big_snake = true;
-          fd[d] = x;
-          if (odd && bmin <= d && d <= bmax && bd[d] <= x)
+          bool found;
+
+          if (bmin > dmin)
+            bd[--bmin - 1] = OFFSET_MAX;
+          else
+            ++bmin;
+          if (bmax < dmax)
+            bd[++bmax + 1] = OFFSET_MAX;
+          else
+            --bmax;
+
+          if (start_backward_sweep (xoff, yoff, bmin, bmax, ctxt))
             {
-              part->xmid = x;
-              part->ymid = y;
-              part->lo_minimal = part->hi_minimal = true;
-              return;
+              found = diag_forward (xlim, ylim, fmin, fmax, odd, prev_bmin,
+                                    prev_bmax, part, &big_snake, ctxt);
+              finish_backward_sweep (&big_snake);
             }
-        }
+          else
+            {
+              parallel = false;
+              found = diag_forward (xlim, ylim, fmin, fmax, odd, prev_bmin,
+                                    prev_bmax, part, &big_snake, ctxt)
+                      || diag_backward (xoff, yoff, bmin, bmax, !odd, fmin,
+                                        fmax, part, &big_snake, ctxt);
+            }
+          if (found)
+            return;
 
-      /* Similarly extend the bottom-up search.  */
-      if (bmin > dmin)
-        bd[--bmin - 1] = OFFSET_MAX;
-      else
-        ++bmin;
-      if (bmax < dmax)
-        bd[++bmax + 1] = OFFSET_MAX;
+          if (!odd)
+            for (d = bmax; d >= bmin; d -= 2)
+              if (fmin <= d && d <= fmax && bd[d] <= fd[d])
+                {
+                  part->xmid = bd[d];
+                  part->ymid = bd[d] - d;
+                  part->lo_minimal = part->hi_minimal = true;
+                  return;
+                }
+        }
       else
-        --bmax;
-      for (d = bmax; d >= bmin; d -= 2)
+#endif
         {
-          OFFSET x;
-          OFFSET y;
-          OFFSET tlo = bd[d - 1];
-          OFFSET thi = bd[d + 1];
-          OFFSET x0 = tlo < thi ? tlo : thi - 1;
-
-          for (x = x0, y = x0 - d;
-               xoff < x && yoff < y && XREF_YREF_EQUAL (x - 1, y - 1);
-               x--, y--)
-            continue;
-          if (x0 - x > SNAKE_LIMIT)
-            big_snake = true;
-          bd[d] = x;
-          if (!odd && fmin <= d && d <= fmax && x <= fd[d])
-            {
-              part->xmid = x;
-              part->ymid = y;
-              part->lo_minimal = part->hi_minimal = true;
-              return;
-            }
+          if (diag_forward (xlim, ylim, fmin, fmax, odd, prev_bmin, prev_bmax,
+                            part, &big_snake, ctxt))
+            return;
+
+          /* Similarly extend the bottom-up search.  */
+          if (bmin > dmin)
+            bd[--bmin - 1] = OFFSET_MAX;
+          else
+            ++bmin;
+          if (bmax < dmax)
+            bd[++bmax + 1] = OFFSET_MAX;
+          else
+            --bmax;
+          if (diag_backward (xoff, yoff, bmin, bmax, !odd, fmin, fmax, part,
+                             &big_snake, ctxt))
+            return;
         }
 
-      if (find_minimal)
+      if (find_minimal && !OUT_OF_BUDGET (ctxt))
         continue;
 
 #ifdef USE_HEURISTIC
@@ -368,8 +628,9 @@ diag (OFFSET xoff, OFFSET xlim, OFFSET yoff, OFFSET ylim, bool find_minimal,
 #endif /* USE_HEURISTIC */
 
       /* Heuristic: if we've gone well beyond the call of duty, give up
-         and report halfway between our best results so far.  */
-      if (c >= ctxt->too_expensive)
+         and report halfway between our best results so far.  The same
+         applies when the budget for the whole computation is exhausted.  */
+      if (c >= ctxt->too_expensive || OUT_OF_BUDGET (ctxt))
         {
           OFFSET fxybest;
           OFFSET fxbest IF_LINT (= 0);
@@ -493,6 +754,20 @@ compareseq (OFFSET xoff, OFFSET xlim, OFFSET yoff, OFFSET ylim,
           return true;
         xoff++;
       }
+  else if (OUT_OF_BUDGET (ctxt))
+    {
+      /* Don't bother looking for a good split anymore; a delete of the
+         remaining part of vector 0 and an insert of the remaining part of
+         vector 1 is a valid, if crude, answer.  */
+      for (; xoff < xlim; xoff++)
+        NOTE_DELETE (ctxt, xoff);
+      for (; yoff < ylim; yoff++)
+        NOTE_INSERT (ctxt, yoff);
+    }
+  else if (SMALL_COMPARE (ctxt, xoff, xlim, yoff, ylim))
+    {
+      /* Already done.  */
+    }
   else
     {
       struct partition part IF_LINT2 (= { .xmid = 0, .ymid = 0 });
@@ -503,6 +778,7 @@ compareseq (OFFSET xoff, OFFSET xlim, OFFSET yoff, OFFSET ylim,
       /* Use the partitions to split this problem into subproblems.  */
       if (compareseq (xoff, part.xmid, yoff, part.ymid, part.lo_minimal, ctxt))
         return true;
+      NOTE_PROGRESS (ctxt, part.xmid, part.ymid);
       if (compareseq (part.xmid, xlim, part.ymid, ylim, part.hi_minimal, ctxt))
         return true;
     }
@@ -518,6 +794,10 @@ compareseq (OFFSET xoff, OFFSET xlim, OFFSET yoff, OFFSET ylim,
 #undef NOTE_DELETE
 #undef NOTE_INSERT
 #undef EARLY_ABORT
+#undef OUT_OF_BUDGET
+#undef NOTE_PROGRESS
+#undef FORCE_THREADS
+#undef SMALL_COMPARE
 #undef USE_HEURISTIC
 #undef XVECREF_YVECREF_EQUAL
 #undef OFFSET_MAX
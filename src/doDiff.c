@@ -24,11 +24,19 @@
 #include "unicode.h"
 #include "diff/diff.h"
 #include "hashtable.h"
+#include "moves.h"
+#include "script.h"
+#include "phases.h"
 
 static const char resetColor[] = "\033[0m";
 static const char eraseLine[] = "\033[K";
 static unsigned int oldLineNumber = 1, newLineNumber = 1;
+/* The line numbers at the start of the current files, which differ from 1 for --diff-input. */
+static unsigned int oldFirstLineNumber, newFirstLineNumber;
 static bool lastWasLinefeed = true, lastWasDelete = false, lastWasCarriageReturn = false;
+/* The edit script to print, and scratch storage for the edit scripts of
+   computeScript and its recursive calls. */
+static ChangeVector editScript, scratchScript;
 
 /** Check whether the last-read character equals a certain value.
 
@@ -55,17 +63,19 @@ static bool readNextChar(Stream *stream) {
 static void addCharData(bool common) {
 #ifdef USE_UNICODE
 	if (UTF8Mode) {
-		size_t i;
-		char encoded[4];
-		int bytes, j;
+		size_t i, fill = 0;
+		/* Collect the encoded cluster, such that it can be written as a single slice. */
+		char encoded[64];
 		UChar32 highSurrogate = 0;
 
 		for (i = 0; i < charData.UTF8Char.original.used; i++) {
-			bytes = filteredConvertToUTF8(charData.UTF8Char.original.data[i], encoded, &highSurrogate);
-
-			for (j = 0; j < bytes; j++)
-				addchar(encoded[j], common);
+			if (fill > sizeof(encoded) - 4) {
+				addchars(encoded, fill, common);
+				fill = 0;
+			}
+			fill += filteredConvertToUTF8(charData.UTF8Char.original.data[i], encoded + fill, &highSurrogate);
 		}
+		addchars(encoded, fill, common);
 		return;
 	}
 #endif
@@ -75,6 +85,106 @@ static void addCharData(bool common) {
 /* Note: ADD should be 0, OLD_COMMON should be DEL + COMMON. */
 typedef enum {ADD, DEL, COMMON, OLD_COMMON} Mode;
 
+/* Set while printing text that is part of a moved block. */
+static bool printingMove;
+
+/* The byte sequences written at the transitions between common and changed
+   text. They depend only on the options and the type of change, so they are
+   concatenated once before printing, rather than checking the options at
+   every transition. */
+typedef enum {
+	/* Before the first character of changed text. */
+	TRANSITION_START,
+	/* After the last character of changed text. */
+	TRANSITION_STOP,
+	/* Before a newline or carriage return in changed text. */
+	TRANSITION_LINE_END,
+	/* Before the line numbers at the start of a line of changed text. */
+	TRANSITION_LINE_NUMBERS,
+	/* At the start of a line of changed text, after the line numbers. */
+	TRANSITION_LINE_START,
+	TRANSITION_COUNT
+} Transition;
+
+/* The sequences, indexed by whether a moved block is printed, the mode (ADD
+   or DEL) and the transition. */
+static CharBuffer transitions[2][2][TRANSITION_COUNT];
+
+/** Append a string to a transition sequence. */
+static void appendTransition(CharBuffer *sequence, const char *data, size_t length) {
+	VECTOR_ALLOCATE(*sequence, length);
+	memcpy(sequence->data + sequence->used, data, length);
+	sequence->used += length;
+}
+
+/** Build the transition sequences for the current options. */
+static void initTransitions(void) {
+	int moved, mode, transition;
+
+	for (moved = 0; moved < 2; moved++) {
+		for (mode = ADD; mode <= DEL; mode++) {
+			CharBuffer *sequences = transitions[moved][mode];
+			const char *color, *start, *stop;
+			size_t colorLen, startLen, stopLen;
+
+			if (mode == ADD) {
+				color = moved ? option.moveAddColor : option.addColor;
+				colorLen = moved ? option.moveAddColorLen : option.addColorLen;
+				start = moved ? option.moveAddStart : option.addStart;
+				startLen = moved ? option.moveAddStartLen : option.addStartLen;
+				stop = moved ? option.moveAddStop : option.addStop;
+				stopLen = moved ? option.moveAddStopLen : option.addStopLen;
+			} else {
+				color = moved ? option.moveDelColor : option.delColor;
+				colorLen = moved ? option.moveDelColorLen : option.delColorLen;
+				start = moved ? option.moveDelStart : option.delStart;
+				startLen = moved ? option.moveDelStartLen : option.delStartLen;
+				stop = moved ? option.moveDelStop : option.delStop;
+				stopLen = moved ? option.moveDelStopLen : option.delStopLen;
+			}
+
+			for (transition = 0; transition < TRANSITION_COUNT; transition++)
+				sequences[transition].used = 0;
+
+			if (option.colorMode)
+				appendTransition(&sequences[TRANSITION_LINE_NUMBERS], resetColor, sizeof(resetColor) - 1);
+
+			if (!option.needStartStop)
+				continue;
+
+			if (option.colorMode)
+				appendTransition(&sequences[TRANSITION_START], color, colorLen);
+			appendTransition(&sequences[TRANSITION_START], start, startLen);
+
+			appendTransition(&sequences[TRANSITION_STOP], stop, stopLen);
+			if (option.colorMode)
+				appendTransition(&sequences[TRANSITION_STOP], resetColor, sizeof(resetColor) - 1);
+
+			if (option.repeatMarkers)
+				appendTransition(&sequences[TRANSITION_LINE_END], stop, stopLen);
+			if (option.colorMode)
+				/* Erase rest of line so it will use the correct background color */
+				appendTransition(&sequences[TRANSITION_LINE_END], eraseLine, sizeof(eraseLine) - 1);
+
+			if (option.colorMode)
+				appendTransition(&sequences[TRANSITION_LINE_START], color, colorLen);
+			if (option.repeatMarkers)
+				appendTransition(&sequences[TRANSITION_LINE_START], start, startLen);
+		}
+	}
+}
+
+/** Write the sequence for a transition in changed text.
+	@param mode Either ADD or DEL.
+	@param transition The transition to write the sequence for.
+*/
+static void writeTransition(Mode mode, Transition transition) {
+	const CharBuffer *sequence = &transitions[printingMove][mode][transition];
+
+	if (sequence->used != 0)
+		writeString(sequence->data, sequence->used);
+}
+
 /** If the last character printed was a newline, do some special handling.
 	@param mode What kind of output is generated next.
 */
@@ -85,73 +195,115 @@ static void doPostLinefeed(Mode mode) {
 
 		lastWasLinefeed = false;
 		if (option.lineNumbers) {
-			if (option.colorMode && mode != COMMON)
-				writeString(resetColor, sizeof(resetColor) - 1);
+			if (mode != COMMON)
+				writeTransition(mode, TRANSITION_LINE_NUMBERS);
 			printLineNumbers(oldLineNumber, newLineNumber);
 		}
-		if (option.needStartStop && mode != COMMON) {
-			if (option.colorMode) {
-				if (mode == ADD)
-					writeString(option.addColor, option.addColorLen);
-				else
-					writeString(option.delColor, option.delColorLen);
-			}
-			if (option.repeatMarkers) {
-				if (mode == ADD)
-					writeString(option.addStart, option.addStartLen);
-				else
-					writeString(option.delStart, option.delStartLen);
-			}
-		}
+		if (mode != COMMON)
+			writeTransition(mode, TRANSITION_LINE_START);
 	}
 }
 
 
-/** Handle a single whitespace character.
+/** Check whether every byte of @a data is a character on its own.
+	@param data The text to check, UTF-8 encoded in UTF-8 mode.
+	@param length The number of bytes in @a data.
+
+	In UTF-8 mode, this is the case for ASCII text, as ASCII characters are
+	never combined into a single cluster except for a CR LF pair.
+*/
+static bool isSingleByteText(const char *data, size_t length) {
+#ifdef USE_UNICODE
+	size_t i;
+
+	if (UTF8Mode) {
+		for (i = 0; i < length; i++) {
+			if ((unsigned char) data[i] >= 0x80)
+				return false;
+		}
+	}
+#else
+	(void) data;
+	(void) length;
+#endif
+	return true;
+}
+
+/** Handle the start of a span of whitespace.
+	@param data The whitespace, UTF-8 encoded in UTF-8 mode.
+	@param length The number of bytes in @a data, which must be at least 1.
 	@param print Skip or print.
 	@param mode What type of output to generate.
+	@param lineNumber The line counter to increment if a newline is handled.
+	@return The number of bytes handled.
+
+	Either a single newline or carriage return is handled, or a run of
+	characters up to the next newline or carriage return. Both are control
+	characters, which are always a (grapheme) cluster on their own, and their
+	bytes can not be part of a UTF-8 multi-byte sequence.
 */
-static void handleWhitespaceChar(bool print, Mode mode) {
-	if (print) {
-		doPostLinefeed(mode);
+static size_t handleWhitespaceSpan(const char *data, size_t length, bool print, Mode mode, unsigned int *lineNumber) {
+	size_t bytes = 1;
 
-		/* Less mode also over-strikes whitespace */
-		if (option.less && !charDataEquals('\n') && !charDataEquals('\r') && mode == DEL) {
-			addchar('_', mode & COMMON);
-			addchar('\010', mode & COMMON);
-		} else if (option.needStartStop && (mode & COMMON) != COMMON && (charDataEquals('\r')  || (!lastWasCarriageReturn && charDataEquals('\n')))) {
-			if (option.repeatMarkers) {
-				if (mode == ADD)
-					writeString(option.addStop, option.addStopLen);
-				else
-					writeString(option.delStop, option.delStopLen);
-			}
+	if (*data != '\n' && *data != '\r') {
+		while (bytes < length && data[bytes] != '\n' && data[bytes] != '\r')
+			bytes++;
+	}
 
-			if (option.colorMode)
-				/* Erase rest of line so it will use the correct background color */
-				writeString(eraseLine, sizeof(eraseLine) - 1);
-		}
-		addCharData(mode & COMMON);
+	if (!print) {
+		if (*data == '\n')
+			(*lineNumber)++;
+		return bytes;
+	}
 
-		if (charDataEquals('\n'))
-			lastWasLinefeed = true;
+	doPostLinefeed(mode);
 
-		lastWasCarriageReturn = charDataEquals('\r');
+	if (*data == '\n' || *data == '\r') {
+		if ((mode & COMMON) != COMMON && (*data == '\r' || !lastWasCarriageReturn))
+			writeTransition(mode, TRANSITION_LINE_END);
+		addchar(*data, mode & COMMON);
+
+		if (*data == '\n') {
+			lastWasLinefeed = true;
+			(*lineNumber)++;
+		}
+		lastWasCarriageReturn = *data == '\r';
+		return bytes;
 	}
 
-	if (charDataEquals('\n')) {
-		switch (mode) {
-			case COMMON:
-			case ADD:
-				newLineNumber++;
-				break;
-			case OLD_COMMON:
-			case DEL:
-				oldLineNumber++;
-				break;
-			default:
-				PANIC();
+	/* Less mode also over-strikes whitespace. */
+	if (option.less && mode == DEL) {
+		if (isSingleByteText(data, bytes)) {
+			addOverstrike(data, bytes, true);
+		} else {
+			Stream stream;
+
+			initStringStream(&stream, data, bytes);
+			while (readNextChar(&stream)) {
+				addchar('_', false);
+				addchar('\010', false);
+				addCharData(false);
+			}
 		}
+	} else {
+		addchars(data, bytes, mode & COMMON);
+	}
+	lastWasCarriageReturn = false;
+	return bytes;
+}
+
+/** Read the next bit of whitespace from the temporary file into the whitespace buffer.
+	@param file The file with whitespace.
+*/
+static void readNextWhitespace(InputFile *file) {
+	int c;
+
+	file->whitespaceBuffer.used = 0;
+	while ((c = sgetc(file->whitespace->stream)) != EOF && c != 0) {
+		/* Unescape the characters, if necessary. */
+		if (c == 1 && (c = sgetc(file->whitespace->stream)) == EOF)
+			fatal(_("Error reading back input\n"));
+		VECTOR_APPEND(file->whitespaceBuffer, c);
 	}
 }
 
@@ -161,25 +313,17 @@ static void handleWhitespaceChar(bool print, Mode mode) {
 	@param mode What type of output to generate.
 */
 static void handleNextWhitespace(InputFile *file, bool print, Mode mode) {
-	if (file->whitespaceBufferUsed) {
-		Stream *stream = newStringStream(file->whitespaceBuffer.data, file->whitespaceBuffer.used);
-		while (readNextChar(stream))
-			handleWhitespaceChar(print, mode);
-		free(stream);
-		file->whitespaceBuffer.used = 0;
-		file->whitespaceBufferUsed = false;
-	} else {
-		while (readNextChar(file->whitespace->stream)) {
-			if (charDataEquals(0))
-				return;
+	unsigned int *lineNumber = mode == COMMON || mode == ADD ? &newLineNumber : &oldLineNumber;
+	size_t i;
 
-			if (charDataEquals(1)) {
-				if (!readNextChar(file->whitespace->stream))
-					fatal(_("Error reading back input\n"));
-			}
-			handleWhitespaceChar(print, mode);
-		}
-	}
+	if (!file->whitespaceBufferUsed)
+		readNextWhitespace(file);
+
+	for (i = 0; i < file->whitespaceBuffer.used; )
+		i += handleWhitespaceSpan(file->whitespaceBuffer.data + i, file->whitespaceBuffer.used - i, print, mode, lineNumber);
+
+	file->whitespaceBuffer.used = 0;
+	file->whitespaceBufferUsed = false;
 }
 
 /** Skip or print the next bit of whitespace from the new or old file, keeping
@@ -194,114 +338,92 @@ static void handleSynchronizedNextWhitespace(bool printNew) {
 	static_assert(CRLF_GRAPHEME_CLUSTER_BREAK == 0);
 #endif
 
-	bool BValid = true;
+	InputFile *fileA, *fileB;
 	unsigned int *lineNumberA, *lineNumberB;
-	Stream *whitespaceA, *whitespaceB;
+	size_t i, newlinesB = 0;
 
-	Stream *oldFileWhitespaceStream = option.oldFile.whitespaceBufferUsed ?
-			newStringStream(option.oldFile.whitespaceBuffer.data, option.oldFile.whitespaceBuffer.used) :
-			option.oldFile.whitespace->stream;
-	Stream *newFileWhitespaceStream = option.newFile.whitespaceBufferUsed ?
-			newStringStream(option.newFile.whitespaceBuffer.data, option.newFile.whitespaceBuffer.used) :
-			option.newFile.whitespace->stream;
+	if (!option.oldFile.whitespaceBufferUsed)
+		readNextWhitespace(&option.oldFile);
+	if (!option.newFile.whitespaceBufferUsed)
+		readNextWhitespace(&option.newFile);
 
 	if (printNew) {
-		whitespaceA = newFileWhitespaceStream;
-		whitespaceB = oldFileWhitespaceStream;
+		fileA = &option.newFile;
+		fileB = &option.oldFile;
 		lineNumberA = &newLineNumber;
 		lineNumberB = &oldLineNumber;
 	} else {
-		whitespaceA = oldFileWhitespaceStream;
-		whitespaceB = newFileWhitespaceStream;
+		fileA = &option.oldFile;
+		fileB = &option.newFile;
 		lineNumberA = &oldLineNumber;
 		lineNumberB = &newLineNumber;
 	}
 
-	while (readNextChar(whitespaceA)) {
-		if (charDataEquals(0))
-			break;
-
-		if (charDataEquals(1)) {
-			if (!readNextChar(whitespaceA))
-				fatal(_("Error reading back input\n"));
-		}
-
-		if (option.printCommon) {
-			doPostLinefeed(COMMON);
+	for (i = 0; i < fileB->whitespaceBuffer.used; i++) {
+		if (fileB->whitespaceBuffer.data[i] == '\n')
+			newlinesB++;
+	}
 
-			/* Note that we don't have to check less mode here as we only print
-			   common whitespace. */
-			addCharData(true);
+	for (i = 0; i < fileA->whitespaceBuffer.used; ) {
+		bool newline = fileA->whitespaceBuffer.data[i] == '\n';
 
-			if (charDataEquals('\n'))
-				lastWasLinefeed = true;
+		/* Note that we don't have to check less mode here as we only print
+		   common whitespace. */
+		i += handleWhitespaceSpan(fileA->whitespaceBuffer.data + i, fileA->whitespaceBuffer.used - i,
+			option.printCommon, COMMON, lineNumberA);
 
-			lastWasCarriageReturn = charDataEquals('\r');
-		}
-
-		/* If a newline was found, see if the B file also has a newline. */
-		if (charDataEquals('\n')) {
-			(*lineNumberA)++;
-			/* Only process the B file if it has not reached then end of the token yet. */
-			if (BValid) {
-				bool result;
-				while ((result = readNextChar(whitespaceB))) {
-					if (charDataEquals(0))
-						break;
-
-					if (charDataEquals(1)) {
-						if (!readNextChar(whitespaceB))
-							fatal(_("Error reading back input\n"));
-					}
-
-					if (charDataEquals('\n')) {
-						(*lineNumberB)++;
-						break;
-					}
-				}
-				if (charDataEquals(0) || !result)
-					BValid = false;
-			}
+		/* If a newline was found, let the B file catch up to its next newline. */
+		if (newline && newlinesB > 0) {
+			(*lineNumberB)++;
+			newlinesB--;
 		}
 	}
 
-	/* Process any remaining whitespace from the BS file. */
-	if (BValid) {
-		while (readNextChar(whitespaceB)) {
-			if (charDataEquals(0))
-				break;
-
-			if (charDataEquals(1)) {
-				if (!readNextChar(whitespaceB))
-					fatal(_("Error reading back input\n"));
-			}
+	/* Process any remaining newlines from the B file. */
+	*lineNumberB += newlinesB;
+}
 
-			if (charDataEquals('\n'))
-				(*lineNumberB)++;
-		}
-	}
+/* The characters of a changed token which are to be over-struck for printer
+   and less mode, but have not been written yet. Every byte is a character on
+   its own, such that the whole span can be expanded by addOverstrike. */
+static CharBuffer overstrikeSpan;
 
-	if (option.oldFile.whitespaceBufferUsed)
-		free(oldFileWhitespaceStream);
-	if (option.newFile.whitespaceBufferUsed)
-		free(newFileWhitespaceStream);
+/** Write the characters collected in @a overstrikeSpan.
+	@param mode Either ADD or DEL.
+*/
+static void flushOverstrike(Mode mode) {
+	if (overstrikeSpan.used == 0)
+		return;
+	addOverstrike(overstrikeSpan.data, overstrikeSpan.used, mode == DEL);
+	overstrikeSpan.used = 0;
 }
 
-/** Wrapper for addchar which takes printer and less mode into account
-	@param mode What type of output to generate.
+/** Over-strike the last-read character for printer and less mode.
+	@param mode Either ADD or DEL.
+
+	Single byte characters are collected in @a overstrikeSpan. Other grapheme
+	clusters are written directly, after the collected characters.
 */
-void addTokenChar(Mode mode) {
-	/* Printer mode and less mode do special stuff, per character. */
-	if ((option.printer || option.less) && !charDataEquals('\n') && !charDataEquals('\r')) {
+static void addOverstrikeCharData(Mode mode) {
+#ifdef USE_UNICODE
+	if (UTF8Mode) {
+		if (charData.UTF8Char.original.used == 1 && charData.UTF8Char.original.data[0] < 0x80) {
+			VECTOR_APPEND(overstrikeSpan, charData.UTF8Char.original.data[0]);
+			return;
+		}
+		flushOverstrike(mode);
 		if (mode == DEL) {
-			addchar('_', mode & COMMON);
-			addchar('\010', mode & COMMON);
-		} else if (mode == ADD) {
-			addCharData(mode & COMMON);
-			addchar('\010', mode & COMMON);
+			addchar('_', false);
+			addchar('\010', false);
+		} else {
+			addCharData(false);
+			addchar('\010', false);
 		}
+		addCharData(false);
+		return;
 	}
-	addCharData(mode & COMMON);
+#endif
+	VECTOR_APPEND(overstrikeSpan, charData.singleChar);
 }
 
 /** Skip or print the next token from @a file.
@@ -310,20 +432,21 @@ void addTokenChar(Mode mode) {
 	@param mode What type of output to generate.
 */
 static void handleNextToken(TempFile *file, bool print, Mode mode) {
+	/* Printer mode and less mode over-strike the changed characters. */
+	bool overstrike = print && (mode == ADD || mode == DEL) && (option.printer || option.less);
 	bool empty = true;
+
 	while (readNextChar(file->stream)) {
 		if (charDataEquals(0)) {
+			flushOverstrike(mode);
 			/* Check for option.paraDelim _should_ be superfluous, unless there is a bug elsewhere. */
 			if (option.paraDelim && print && empty && mode != COMMON) {
-				Stream *stream = newStringStream(option.paraDelimMarker, option.paraDelimMarkerLength);
-				while (readNextChar(stream)) {
-					/* doPostLinefeed only does something if the last character was a line feed. However,
-					   the paragraph delimiter may contain line feeds as well, so call doPostLinefeed
-					   every time a character was printed. */
+				/* doPostLinefeed only does something if the last character was a line feed,
+				   so it only needs to be called before the first character of the marker. */
+				if (option.paraDelimMarkerLength > 0) {
 					doPostLinefeed(mode);
-					addCharData(mode);
+					addchars(option.paraDelimMarker, option.paraDelimMarkerLength, mode);
 				}
-				free(stream);
 			}
 			return;
 		}
@@ -338,20 +461,19 @@ static void handleNextToken(TempFile *file, bool print, Mode mode) {
 		if (print) {
 			doPostLinefeed(mode);
 
-			if (option.needStartStop && (mode & COMMON) != COMMON && (charDataEquals('\r')  || (!lastWasCarriageReturn && charDataEquals('\n')))) {
-				if (option.repeatMarkers) {
-					if (mode == ADD)
-						writeString(option.addStop, option.addStopLen);
-					else
-						writeString(option.delStop, option.delStopLen);
+			if (overstrike) {
+				if (!charDataEquals('\n') && !charDataEquals('\r')) {
+					addOverstrikeCharData(mode);
+					lastWasCarriageReturn = false;
+					continue;
 				}
-
-				if (option.colorMode)
-					/* Erase rest of line so it will use the correct background color */
-					writeString(eraseLine, sizeof(eraseLine) - 1);
+				flushOverstrike(mode);
 			}
 
-			addTokenChar(mode);
+			if ((mode & COMMON) != COMMON && (charDataEquals('\r')  || (!lastWasCarriageReturn && charDataEquals('\n'))))
+				writeTransition(mode, TRANSITION_LINE_END);
+
+			addCharData(mode & COMMON);
 
 			if (charDataEquals('\n'))
 				lastWasLinefeed = true;
@@ -382,6 +504,7 @@ static void handleNextToken(TempFile *file, bool print, Mode mode) {
 			}
 		}
 	}
+	flushOverstrike(mode);
 }
 
 /** Skip or print the next whitespace and tokens from @a file.
@@ -398,11 +521,111 @@ static void handleWord(InputFile *file, int idx, bool print, Mode mode) {
 	}
 }
 
+/** Get the number of usable checkpoints of @a file. */
+static lin countCheckpoints(InputFile *file) {
+	lin spooled = file->spooledTokens < file->spooledWhitespace ? file->spooledTokens : file->spooledWhitespace;
+	return spooled / SPOOL_CHECKPOINT_INTERVAL + 1;
+}
+
+/** Get the number of newlines in the new file before a checkpoint. */
+#define CHECKPOINT_NEWLINES(x) (option.newFile.checkpoints.data[x].tokenNewlines + option.newFile.checkpoints.data[x].whitespaceNewlines)
+
+/** Find the token in the new file from which the common words before @a idx
+		must be printed to get the context for the change at @a idx.
+	@param idx The first word of the change.
+	@return The index of a token at a checkpoint, or 0 if nothing can be skipped.
+
+	The returned token is followed by more than option.contextLines lines
+	before @a idx, so anything before it would not be printed.
+*/
+static lin findContextStart(lin idx) {
+	lin low = 0, high = idx / SPOOL_CHECKPOINT_INTERVAL, mid, newlines;
+
+	if (high >= countCheckpoints(&option.newFile))
+		high = countCheckpoints(&option.newFile) - 1;
+
+	newlines = CHECKPOINT_NEWLINES(high);
+	if (newlines - CHECKPOINT_NEWLINES(0) <= option.contextLines)
+		return 0;
+
+	/* Find the last checkpoint with more than option.contextLines newlines up
+	   to checkpoint high, keeping the invariant that low satisfies the
+	   condition and high does not. */
+	while (low + 1 < high) {
+		mid = low + (high - low) / 2;
+		if (newlines - CHECKPOINT_NEWLINES(mid) > option.contextLines)
+			low = mid;
+		else
+			high = mid;
+	}
+	return low * SPOOL_CHECKPOINT_INTERVAL;
+}
+
+/** Continue reading @a file at the whitespace preceding token @a idx.
+	@param file The @a InputFile to reposition.
+	@param idx The index of the token.
+	@param lineNumber The line counter for @a file, which is set to the line at
+		the new position.
+	@param firstLineNumber The line number at the start of @a file.
+
+	Only the tokens between the closest checkpoint and @a idx are read.
+*/
+static void seekToken(InputFile *file, lin idx, unsigned int *lineNumber, unsigned int firstLineNumber) {
+	SpoolCheckpoint *checkpoint = &file->checkpoints.data[idx / SPOOL_CHECKPOINT_INTERVAL];
+	lin i, newlines = checkpoint->tokenNewlines + checkpoint->whitespaceNewlines;
+	size_t j;
+	int c;
+
+	if (sfseek(file->tokens->stream, checkpoint->tokenOffset) != 0)
+		fatal(_("Error reading from temporary file: %s\n"), strerror(sgeterrno(file->tokens->stream)));
+	if (sfseek(file->whitespace->stream, checkpoint->whitespaceOffset) != 0)
+		fatal(_("Error reading from temporary file: %s\n"), strerror(sgeterrno(file->whitespace->stream)));
+
+	for (i = idx - idx % SPOOL_CHECKPOINT_INTERVAL; i < idx; i++) {
+		readNextWhitespace(file);
+		for (j = 0; j < file->whitespaceBuffer.used; j++) {
+			if (file->whitespaceBuffer.data[j] == '\n')
+				newlines++;
+		}
+
+		while ((c = sgetc(file->tokens->stream)) != 0) {
+			/* Unescape the characters, if necessary. */
+			if (c == EOF || (c == 1 && (c = sgetc(file->tokens->stream)) == EOF))
+				fatal(_("Error reading back input\n"));
+			if (c == '\n')
+				newlines++;
+		}
+	}
+
+	file->whitespaceBuffer.used = 0;
+	file->whitespaceBufferUsed = false;
+	file->lastPrinted = idx;
+	*lineNumber = firstLineNumber + newlines;
+}
+
+/** Skip the common words up to token @a idx of the new file without reading them.
+	@param idx The index of the token in the new file, which must be at a checkpoint.
+*/
+static void skipCommonWords(lin idx) {
+	seekToken(&option.oldFile, idx + option.oldFile.lastPrinted - option.newFile.lastPrinted,
+		&oldLineNumber, oldFirstLineNumber);
+	seekToken(&option.newFile, idx, &newLineNumber, newFirstLineNumber);
+	lastWasDelete = false;
+}
+
 /** Print (or skip if the user doesn't want to see) the common words.
 	@param idx The last word to print (or skip).
 */
 void printToCommonWord(int idx) {
+	/* In context mode, the common words which would only be dropped from the
+	   context buffers are not read at all. */
+	lin skipTo = option.context && option.printCommon && option.newFile.checkpoints.used != 0 ? findContextStart(idx) : 0;
+
 	while (option.newFile.lastPrinted < idx) {
+		if (skipTo > option.newFile.lastPrinted && skipContext()) {
+			skipCommonWords(skipTo);
+			continue;
+		}
 		handleSynchronizedNextWhitespace(!lastWasDelete);
 		lastWasDelete = false;
 		handleNextToken(option.newFile.tokens, option.printCommon, COMMON);
@@ -429,38 +652,50 @@ static void printWords(lin start, lin count, InputFile *file, bool print, Mode m
 	if (print)
 		doPostLinefeed(COMMON);
 
+	printingMove = file->moveState != NULL && file->moveState[start] == MOVE_MOVED;
+
 	/* Print start marker */
-	if (print && option.needStartStop) {
-		if (mode == ADD) {
-			if (option.colorMode)
-				writeString(option.addColor, option.addColorLen);
-			writeString(option.addStart, option.addStartLen);
-		} else {
-			if (option.colorMode)
-				writeString(option.delColor, option.delColorLen);
-			writeString(option.delStart, option.delStartLen);
-		}
-	}
+	if (print)
+		writeTransition(mode, TRANSITION_START);
 
 	/* Print first word */
 	handleNextToken(file->tokens, print, mode);
 	file->lastPrinted++;
 	/* Print following words */
-	handleWord(file, start + count, print, mode);
+	if (file->moveState == NULL) {
+		handleWord(file, start + count, print, mode);
+	} else {
+		while (file->lastPrinted < start + count) {
+			bool moved = file->moveState[file->lastPrinted] == MOVE_MOVED;
+
+			if (moved == printingMove) {
+				handleNextWhitespace(file, print, mode);
+			} else {
+				/* Switch markers between moved and other text. Like at the start,
+				   the whitespace in between is not marked. */
+				if (print) {
+					doPostLinefeed(mode);
+					writeTransition(mode, TRANSITION_STOP);
+				}
+				printingMove = moved;
+				handleNextWhitespace(file, print, mode + COMMON);
+				if (print) {
+					doPostLinefeed(COMMON);
+					writeTransition(mode, TRANSITION_START);
+				}
+			}
+			handleNextToken(file->tokens, print, mode);
+			file->lastPrinted++;
+		}
+	}
 
 	if (print)
 		doPostLinefeed(mode);
 
 	/* Print stop marker */
-	if (print && option.needStartStop) {
-		if (mode == ADD)
-			writeString(option.addStop, option.addStopLen);
-		else
-			writeString(option.delStop, option.delStopLen);
-
-		if (option.colorMode)
-			writeString(resetColor, sizeof(resetColor) - 1);
-	}
+	if (print)
+		writeTransition(mode, TRANSITION_STOP);
+	printingMove = false;
 }
 
 /** Print (or skip if the user doesn't want to see) deleted words.
@@ -479,13 +714,25 @@ void printAddedWords(struct change *script) {
 
 /** Print (or skip if the user doesn't want to see) the last (common) words of both files. */
 void printEnd(void) {
-	if (!option.printCommon)
+	/* Once the context after the last change has been printed, nothing else
+	   will be shown. Only the words after the last checkpoint are read, to
+	   end in the same state as when reading everything. */
+	lin skipTo = option.context && option.newFile.checkpoints.used != 0 ?
+		(countCheckpoints(&option.newFile) - 1) * SPOOL_CHECKPOINT_INTERVAL : 0;
+
+	if (!option.printCommon || option.outputFormat != FORMAT_TEXT)
 		return;
 	while(!sfeof(option.newFile.tokens->stream)) {
+		if (skipTo > option.newFile.lastPrinted && skipContext()) {
+			skipCommonWords(skipTo);
+			continue;
+		}
 		handleSynchronizedNextWhitespace(!lastWasDelete);
 		lastWasDelete = false;
 		handleNextToken(option.newFile.tokens, true, COMMON);
 		handleNextToken(option.oldFile.tokens, false, OLD_COMMON);
+		option.newFile.lastPrinted++;
+		option.oldFile.lastPrinted++;
 	}
 }
 
@@ -494,42 +741,9 @@ void printEnd(void) {
 	@return a boolean indicating whether a newline was found within the whitespace.
 */
 static bool loadNextWhitespace(InputFile *file) {
-	bool newlineFound = false;
-
 	file->whitespaceBufferUsed = true;
-	file->whitespaceBuffer.used = 0;
-	while (readNextChar(file->whitespace->stream)) {
-		if (charDataEquals(0))
-			return newlineFound;
-
-		if (charDataEquals(1)) {
-			if (!readNextChar(file->whitespace->stream))
-				fatal(_("Error reading back input\n"));
-		}
-
-		if (charDataEquals('\n'))
-			newlineFound = true;
-
-#ifdef USE_UNICODE
-		if (UTF8Mode) {
-			size_t i;
-			char encoded[4];
-			int bytes, j;
-			UChar32 highSurrogate = 0;
-
-			for (i = 0; i < charData.UTF8Char.original.used; i++) {
-				bytes = filteredConvertToUTF8(charData.UTF8Char.original.data[i], encoded, &highSurrogate);
-
-				for (j = 0; j < bytes; j++)
-					VECTOR_APPEND(file->whitespaceBuffer, encoded[j]);
-			}
-		} else
-#endif
-		{
-			VECTOR_APPEND(file->whitespaceBuffer, charData.singleChar);
-		}
-	}
-	return newlineFound;
+	readNextWhitespace(file);
+	return memchr(file->whitespaceBuffer.data, '\n', file->whitespaceBuffer.used) != NULL;
 }
 
 /** Create an array of integers to represent the aggregation of several tokens to a token with context.
@@ -577,15 +791,24 @@ static ValueType *initializeContextDiffTokens(ValueTypeVector *diffTokens, lin *
 	return contextDiffTokens;
 }
 
-/** Read the output of the diff command, and call the appropriate print routines.
+static void refineScript(size_t scriptBase, lin *baseRange, unsigned context);
+
+/** The context used for the comparison of the whole file, for printPartialScript. */
+static unsigned partialContext;
+
+/** Compute the edit script, and append it to @a editScript.
 	@param baseRange The range associated with the diff-token files, or NULL if the whole file.
 	@param context The size of the context used.
+
+	If the match-context option was specified, the changes found are refined
+	through recursive calls with smaller contexts.
 */
-static void doDiffInternal(lin *baseRange, unsigned context) {
-	enum { C_ADD, C_DEL, C_CHANGE } command;
-	bool reverseDeleteAdd = false;
-	struct change *script = NULL, *ptr;
+static void computeScript(lin *baseRange, unsigned context) {
 	struct comparison cmp;
+	/* Recursive calls append their edit script after ours, and remove it
+	   again before returning. */
+	size_t scriptBase = scratchScript.used;
+	void (*partialScript)(ChangeVector *script);
 
 	if (context == 0) {
 		if (baseRange == NULL) {
@@ -601,7 +824,12 @@ static void doDiffInternal(lin *baseRange, unsigned context) {
 		}
 		cmp.file[0].equiv_max = cmp.file[1].equiv_max = baseHashMax;
 
-		script = diff_2_files(&cmp);
+		if (baseRange == NULL)
+			partialContext = context;
+		phaseStart(PHASE_DIFF);
+		phaseCount(PHASE_DIFF, 0, cmp.file[0].buffered_lines + cmp.file[1].buffered_lines);
+		diff_2_files(&cmp, &scratchScript);
+		phaseEnd(PHASE_DIFF);
 	} else {
 		ValueType *oldDiffTokens, *newDiffTokens;
 
@@ -624,63 +852,139 @@ static void doDiffInternal(lin *baseRange, unsigned context) {
 		/* Make sure the context is a multiple of 2. */
 		context &= ~1;
 		if (context == 0) {
-			doDiffInternal(baseRange, context);
+			computeScript(baseRange, context);
 			return;
 		}
 
+		phaseStart(PHASE_MATCH_CONTEXT);
 		oldDiffTokens = initializeContextDiffTokens(&option.oldFile.diffTokens, baseRange, context, cmp.file);
 		newDiffTokens = initializeContextDiffTokens(&option.newFile.diffTokens,
 			baseRange == NULL ? NULL : baseRange + 2, context, cmp.file + 1);
 		cmp.file[0].equiv_max = getHashMax();
+		phaseCount(PHASE_MATCH_CONTEXT, 0, cmp.file[0].buffered_lines + cmp.file[1].buffered_lines);
+		phaseEnd(PHASE_MATCH_CONTEXT);
 
-		script = diff_2_files(&cmp);
+		if (baseRange == NULL)
+			partialContext = context;
+		phaseStart(PHASE_DIFF);
+		phaseCount(PHASE_DIFF, 0, cmp.file[0].buffered_lines + cmp.file[1].buffered_lines);
+		diff_2_files(&cmp, &scratchScript);
+		phaseEnd(PHASE_DIFF);
 
 		free(oldDiffTokens);
 		free(newDiffTokens);
 	}
 
-	if (option.needMarkers && baseRange == NULL)
-		puts("======================================================================");
+	/* Only the comparison of the whole file reports partial scripts. The
+	   comparisons refining its changes are of a range of the file, and
+	   printPartialScript can't place their scripts. */
+	partialScript = diff_partial_script;
+	diff_partial_script = NULL;
+	refineScript(scriptBase, baseRange, context);
+	diff_partial_script = partialScript;
+}
+
+/** Refine the changes found by computeScript, and append them to @a editScript.
+	@param scriptBase The index in @a scratchScript of the first change to refine.
+	@param baseRange The range associated with the diff-token files, or NULL if the whole file.
+	@param context The size of the context used.
+
+	The changes are removed from @a scratchScript.
+*/
+static void refineScript(size_t scriptBase, lin *baseRange, unsigned context) {
+	size_t i;
+
+	for (i = scriptBase; i < scratchScript.used; i++) {
+		/* Copy the change, because recursive calls may reallocate the scratch
+		   script. */
+		struct change change = scratchScript.data[i];
 
-	while (script != NULL) {
 		if (baseRange != NULL) {
-			script->line0 += baseRange[0];
-			script->line1 += baseRange[2];
+			change.line0 += baseRange[0];
+			change.line1 += baseRange[2];
 		}
 
-		command = script->inserted == 0 ? C_DEL : (script->deleted == 0 ? C_ADD : C_CHANGE);
-		differences = 1;
-
-		if (option.matchContext && context != 0) {
+		if (option.matchContext && context != 0 && change.deleted != 0 && change.inserted != 0) {
 			/* If the match-context option was specified, the diff output will
 			   generally be too long. Here we trim the ranges to the minimum
 			   range required to show the diff. However, the ranges are only
 			   too long when the difference is a change, not when it is an add
 			   or delete. */
-			if (command == C_CHANGE) {
-				if (script->deleted <= (lin) context || script->inserted <= (lin) context) {
-					ASSERT(script->deleted != script->inserted);
-					if (script->deleted < script->inserted) {
-						script->inserted -= script->deleted;
-						command = C_ADD;
-					} else if (script->inserted < script->deleted) {
-						script->deleted -= script->inserted;
-						command = C_DEL;
-					}
-				} else if (!option.aggregateChanges) {
-					/* Result must be multiple of two, so divide by 4 first, and
-					   then multiply by 2. */
-					unsigned newContext = (context / 4) * 2;
-					lin range[4] = { script->line0, script->deleted - context, script->line1, script->inserted - context };
-
-					doDiffInternal(range, newContext);
-					goto nextDiff;
-				} else {
-					script->deleted -= context;
-					script->inserted -= context;
+			if (change.deleted <= (lin) context || change.inserted <= (lin) context) {
+				ASSERT(change.deleted != change.inserted);
+				if (change.deleted < change.inserted) {
+					change.inserted -= change.deleted;
+					change.deleted = 0;
+				} else if (change.inserted < change.deleted) {
+					change.deleted -= change.inserted;
+					change.inserted = 0;
 				}
+			} else if (!option.aggregateChanges) {
+				/* Result must be multiple of two, so divide by 4 first, and
+				   then multiply by 2. */
+				unsigned newContext = (context / 4) * 2;
+				lin range[4] = { change.line0, change.deleted - context, change.line1, change.inserted - context };
+
+				phaseStart(PHASE_MATCH_CONTEXT);
+				computeScript(range, newContext);
+				phaseEnd(PHASE_MATCH_CONTEXT);
+				continue;
+			} else {
+				change.deleted -= context;
+				change.inserted -= context;
 			}
 		}
+		VECTOR_APPEND(editScript, change);
+	}
+	scratchScript.used = scriptBase;
+}
+
+/** Add a change to the statistics.
+	@param script The change to add.
+*/
+static void updateStatistics(const struct change *script) {
+	if (script->inserted == 0) {
+		statistics.deleted += script->deleted;
+	} else if (script->deleted == 0) {
+		statistics.added += script->inserted;
+	} else {
+		statistics.newChanged += script->inserted;
+		statistics.oldChanged += script->deleted;
+	}
+}
+
+/** Count the differences in @a editScript without printing them.
+	@param count The number of changes from @a editScript to count.
+*/
+static void countScript(size_t count) {
+	size_t i;
+
+	if (count != 0)
+		differences = 1;
+	for (i = 0; i < count; i++)
+		updateStatistics(editScript.data + i);
+}
+
+/** Print the differences in @a editScript.
+	@param count The number of changes from @a editScript to print.
+
+	The changes are not counted, see @a countScript.
+*/
+static void printScript(size_t count) {
+	enum { C_ADD, C_DEL, C_CHANGE } command;
+	bool reverseDeleteAdd = false;
+	struct change *script;
+	size_t i;
+
+	if (option.outputFormat != FORMAT_TEXT) {
+		writeScript(editScript.data, count);
+		return;
+	}
+
+	for (i = 0; i < count; i++) {
+		script = editScript.data + i;
+
+		command = script->inserted == 0 ? C_DEL : (script->deleted == 0 ? C_ADD : C_CHANGE);
 
 		/* Print common words. */
 		printToCommonWord(script->line1);
@@ -720,41 +1024,241 @@ static void doDiffInternal(lin *baseRange, unsigned context) {
 				printAddedWords(script);
 		}
 		if (option.needMarkers) {
-			puts("\n======================================================================");
+			outputWrite("\n======================================================================\n", 72);
 			lastWasLinefeed = true;
 		}
 
 		if (command == C_DEL && option.printDeleted && !option.wdiffOutput)
 			lastWasDelete = true;
+	}
+}
+
+/** Print a part of the edit script that became final during the comparison of the whole file.
+	@param script The changes, which are refined like the changes found by computeScript.
 
-		/* Update statistics */
-		switch (command) {
-			case C_ADD:
-				statistics.added += script->inserted;
-				break;
-			case C_DEL:
-				statistics.deleted += script->deleted;
-				break;
-			case C_CHANGE:
-				statistics.newChanged += script->inserted;
-				statistics.oldChanged += script->deleted;
-				break;
-			default:
-				PANIC();
-		}
-nextDiff:
-		ptr = script;
-		script = script->link;
-		free(ptr);
+	Called by @a diff_2_files for --incremental.
+*/
+static void printPartialScript(ChangeVector *script) {
+	size_t scriptBase = scratchScript.used, i;
+
+	for (i = 0; i < script->used; i++)
+		VECTOR_APPEND(scratchScript, script->data[i]);
+	refineScript(scriptBase, NULL, partialContext);
+	phaseStart(PHASE_OUTPUT);
+	printScript(editScript.used);
+	phaseEnd(PHASE_OUTPUT);
+	countScript(editScript.used);
+	editScript.used = 0;
+	outputSubmit();
+}
+
+/** Slide the window of @a file forward, and refill it from the spooled token values.
+	@param file The @a InputFile to refill.
+	@param drop The number of tokens at the start of the window that have been handled.
+	@return Whether the window now extends to the end of @a file.
+*/
+static bool fillWindow(InputFile *file, lin drop) {
+	ValueTypeVector *tokens = &file->diffTokens;
+	File *values = file->values->stream->data.file;
+	ValueType value;
+	size_t i;
+	int c;
+
+	tokens->used -= drop;
+	memmove(tokens->data, tokens->data + drop, tokens->used * sizeof(ValueType));
+	VECTOR_ALLOCATE(*tokens, option.window);
+
+	while (tokens->used < option.window) {
+		for (i = 0; i < sizeof(value); i++) {
+			if ((c = fileGetc(values)) == EOF) {
+				if (fileError(values))
+					fatal(_("Error reading from temporary file: %s\n"), strerror(fileGetErrno(values)));
+				return true;
+			}
+			((char *) &value)[i] = c;
+		}
+		tokens->data[tokens->used++] = value;
+	}
+	/* Check whether the window happens to end exactly at the end of the file. */
+	if ((c = fileGetc(values)) == EOF)
+		return true;
+	fileUngetc(values, c);
+	return false;
+}
+
+/** Find the point up to which the edit script of a window can be trusted.
+	@param limit The maximum number of tokens of the old and new window to use.
+	@param commit Returns the number of tokens of the old and new window before the point.
+	@return The number of changes in @a editScript before the point.
+
+	Changes are only reliable when they are far enough away from the end of
+	the window, because the text following the window may still match text
+	in the window. The point is therefore chosen in the last stretch of common
+	text that starts before @a limit.
+*/
+static size_t findCommitPoint(const lin *limit, lin *commit) {
+	lin common;
+	size_t i;
+
+	commit[0] = commit[1] = 0;
+	for (i = 0; i < editScript.used; i++) {
+		struct change *change = editScript.data + i;
+
+		if (change->line0 > limit[0] || change->line1 > limit[1])
+			break;
+		commit[0] = change->line0 + change->deleted;
+		commit[1] = change->line1 + change->inserted;
+		if (commit[0] > limit[0] || commit[1] > limit[1]) {
+			/* The change extends beyond the limit, so stop at its start. */
+			commit[0] = change->line0;
+			commit[1] = change->line1;
+			return i;
+		}
 	}
+
+	common = limit[0] - commit[0];
+	if (common > limit[1] - commit[1])
+		common = limit[1] - commit[1];
+	commit[0] += common;
+	commit[1] += common;
+	return i;
+}
+
+/** Compute and print (or count) the differences one window at a time, for --window. */
+static void doWindowedDiff(void) {
+	lin base[2] = { 0, 0 }, commit[2] = { 0, 0 }, limit[2];
+	bool oldAtEnd, newAtEnd;
+	size_t count, i;
+
+	do {
+		oldAtEnd = fillWindow(&option.oldFile, commit[0]);
+		newAtEnd = fillWindow(&option.newFile, commit[1]);
+
+		editScript.used = 0;
+		computeScript(NULL, option.matchContext);
+
+		if (oldAtEnd && newAtEnd) {
+			count = editScript.used;
+		} else {
+			/* Keep the last quarter of the window for the next round. */
+			limit[0] = (lin) option.oldFile.diffTokens.used - (lin) (option.window / 4);
+			limit[1] = (lin) option.newFile.diffTokens.used - (lin) (option.window / 4);
+			if (limit[0] < 0)
+				limit[0] = 0;
+			if (limit[1] < 0)
+				limit[1] = 0;
+			count = findCommitPoint(limit, commit);
+			if (commit[0] == 0 && commit[1] == 0) {
+				/* A single change spans the whole window. Take the window as is,
+				   to make sure we make progress. */
+				count = editScript.used;
+				commit[0] = option.oldFile.diffTokens.used;
+				commit[1] = option.newFile.diffTokens.used;
+			}
+		}
+
+		for (i = 0; i < count; i++) {
+			editScript.data[i].line0 += base[0];
+			editScript.data[i].line1 += base[1];
+		}
+		if (!option.statisticsOnly) {
+			phaseStart(PHASE_OUTPUT);
+			printScript(count);
+			phaseEnd(PHASE_OUTPUT);
+		}
+		countScript(count);
+		base[0] += commit[0];
+		base[1] += commit[1];
+	} while (!oldAtEnd || !newAtEnd);
 }
 
-/** Do the difference action. */
+/** Prepare for printing the output from the start of the temporary files. */
+static void startPrinting(void) {
+	option.oldFile.lastPrinted = 0;
+	option.newFile.lastPrinted = 0;
+	oldFirstLineNumber = oldLineNumber;
+	newFirstLineNumber = newLineNumber;
+	initTransitions();
+
+	if (option.outputFormat != FORMAT_TEXT)
+		writeScriptHeader();
+	else if (option.needMarkers)
+		outputWrite("======================================================================\n", 71);
+}
+
+/** Do the difference action.
+
+	With --emit, the edit script is only computed, and printed by @a printDiff.
+*/
 void doDiff(void) {
+	if (option.statisticsOnly || emitTargets.used != 0) {
+		/* Only the statistics are needed, which follow directly from the edit script. */
+		if (option.window != 0) {
+			doWindowedDiff();
+		} else {
+			editScript.used = 0;
+			computeScript(NULL, option.matchContext);
+			if (emitTargets.used != 0 && option.detectMoves)
+				detectMoves(&editScript, option.detectMoves);
+			countScript(editScript.used);
+		}
+		return;
+	}
+
 	VECTOR_INIT_ALLOCATED(option.oldFile.whitespaceBuffer);
 	VECTOR_INIT_ALLOCATED(option.newFile.whitespaceBuffer);
-	option.oldFile.lastPrinted = 0;
-	option.newFile.lastPrinted = 0;
-	doDiffInternal(NULL, option.matchContext);
+	startPrinting();
+
+	if (option.window != 0) {
+		doWindowedDiff();
+	} else {
+		editScript.used = 0;
+		if (option.incremental)
+			diff_partial_script = printPartialScript;
+		computeScript(NULL, option.matchContext);
+		diff_partial_script = NULL;
+		if (option.detectMoves)
+			detectMoves(&editScript, option.detectMoves);
+		phaseStart(PHASE_OUTPUT);
+		printScript(editScript.used);
+		phaseEnd(PHASE_OUTPUT);
+		countScript(editScript.used);
+	}
+	phaseStart(PHASE_OUTPUT);
+	printEnd();
+	phaseEnd(PHASE_OUTPUT);
+}
+
+/** Print the edit script computed by @a doDiff with the current options, for --emit.
+
+	Every call prints the complete output, reading the temporary files from
+	the start.
+*/
+void printDiff(void) {
+	InputFile *files[2] = { &option.oldFile, &option.newFile };
+	int i;
+
+	for (i = 0; i < 2; i++) {
+		InputFile *file = files[i];
+
+		if (file->tokens == NULL)
+			continue;
+		if (sfseek(file->tokens->stream, 0) != 0 || sfseek(file->whitespace->stream, 0) != 0)
+			fatal(_("Error reading from temporary file: %s\n"), strerror(errno));
+		if (file->whitespaceBuffer.data == NULL)
+			VECTOR_INIT_ALLOCATED(file->whitespaceBuffer);
+		file->whitespaceBuffer.used = 0;
+		file->whitespaceBufferUsed = false;
+	}
+	oldLineNumber = newLineNumber = 1;
+	lastWasLinefeed = true;
+	lastWasDelete = lastWasCarriageReturn = false;
+	resetOutputState();
+
+	phaseStart(PHASE_OUTPUT);
+	startPrinting();
+	printScript(editScript.used);
 	printEnd();
+	outputFlush();
+	phaseEnd(PHASE_OUTPUT);
 }
@@ -27,6 +27,7 @@
 #include "dispatch.h"
 #include "buffer.h"
 #include "hashtable.h"
+#include "phases.h"
 
 typedef enum {
 	NONE,
@@ -51,13 +52,100 @@ bool tokenWritten;
     sense in this case. */
 CharData charData;
 
+/** The reading of a file for --brief. */
+typedef struct {
+	InputFile *file;
+	MatchState state;
+	int wordCount;
+	bool atEnd;
+	/* The values of currentWord, whitespaceBuffer and tokenWritten for this
+	   file, while the other file is being read. */
+	CharBuffer word;
+	CharBuffer whitespace;
+	bool tokenWritten;
+	/* The tokens that have been read but not compared yet, stored back to
+	   back, and their lengths. */
+	CharBuffer tokens;
+	VECTOR(size_t, lengths);
+} BriefFile;
+
+/** The file being read for --brief, or NULL. */
+static BriefFile *briefFile;
+
+/** Get the checkpoint for @a file for the @a count'th token or piece of whitespace.
+	@param file The @a InputFile to get the checkpoint for.
+	@param count The number of tokens or pieces of whitespace spooled, which
+		must be a multiple of SPOOL_CHECKPOINT_INTERVAL.
+*/
+static SpoolCheckpoint *getCheckpoint(InputFile *file, lin count) {
+	size_t index = count / SPOOL_CHECKPOINT_INTERVAL;
+
+	while (file->checkpoints.used <= index) {
+		VECTOR_ALLOCATE(file->checkpoints, 1);
+		memset(&file->checkpoints.data[file->checkpoints.used++], 0, sizeof(SpoolCheckpoint));
+	}
+	return &file->checkpoints.data[index];
+}
+
+/** Advance the position in the input text of @a file, for --output-format.
+	@param file The @a InputFile being read.
+	@param bytes The number of bytes of the character read.
+	@param newline Whether the character is a newline.
+	@param whitespace Whether the character is whitespace, in which case the
+		next token starts after it.
+*/
+static void advancePosition(InputFile *file, size_t bytes, bool newline, bool whitespace) {
+	file->textOffset += bytes;
+	file->lastByteLine = file->textLine;
+	if (newline)
+		file->textLine++;
+	if (whitespace) {
+		file->tokenOffset = file->textOffset;
+		file->tokenLine = file->textLine;
+	}
+}
+
 static void writeEndOfToken(InputFile *file) {
 	ValueType wordValue;
-	sputc(file->tokens->stream, 0);
+
+	if (briefFile != NULL) {
+		/* Queue the token for comparison with the other file. */
+		VECTOR_ALLOCATE(briefFile->tokens, currentWord.used);
+		memcpy(briefFile->tokens.data + briefFile->tokens.used, currentWord.data, currentWord.used);
+		briefFile->tokens.used += currentWord.used;
+		VECTOR_APPEND(briefFile->lengths, currentWord.used);
+		tokenWritten = true;
+		currentWord.used = 0;
+		return;
+	}
+
+	if (file->tokens != NULL) {
+		sputc(file->tokens->stream, 0);
+		if (option.context && ++file->spooledTokens % SPOOL_CHECKPOINT_INTERVAL == 0) {
+			SpoolCheckpoint *checkpoint = getCheckpoint(file, file->spooledTokens);
+			checkpoint->tokenOffset = sftell(file->tokens->stream);
+			checkpoint->tokenNewlines = file->tokenNewlines;
+		}
+	}
+
+	if (option.tokenPositions) {
+		TokenPosition position;
+
+		position.start = file->tokenOffset;
+		position.end = file->textOffset;
+		position.firstLine = file->tokenLine;
+		position.lastLine = position.end > position.start ? file->lastByteLine : file->tokenLine;
+		VECTOR_APPEND(file->positions, position);
+		file->tokenOffset = file->textOffset;
+		file->tokenLine = file->textLine;
+	}
 
 	wordValue = getValueFromContext(&currentWord);
 	tokenWritten = true;
-	VECTOR_APPEND(file->diffTokens, wordValue);
+	if (file->values != NULL)
+		swrite(file->values->stream, (const char *) &wordValue, sizeof(wordValue));
+	else
+		VECTOR_APPEND(file->diffTokens, wordValue);
 	/* Reset current word */
 	currentWord.used = 0;
 }
@@ -83,15 +171,27 @@ void writeTokenCharSC(InputFile *file) {
 
 	VECTOR_APPEND(currentWord, diffChar);
 
+	if (option.tokenPositions)
+		advancePosition(file, 1, charData.singleChar == '\n', false);
+
+	if (file->tokens == NULL)
+		return;
+
 	if (charData.singleChar == 0 || charData.singleChar == 1)
 		filePutc(file->tokens->stream->data.file, 1);
+	else if (charData.singleChar == '\n')
+		file->tokenNewlines++;
 
 	filePutc(file->tokens->stream->data.file, charData.singleChar);
 }
 
 void writeWhitespaceCharSC(InputFile *file) {
-	/* Don't want to change interface (yet), so prevent warning. */
-	(void) file;
+	if (option.tokenPositions)
+		advancePosition(file, 1, charData.singleChar == '\n', true);
+
+	/* The whitespace is only needed for its newlines in paragraph delimiter mode. */
+	if (file->whitespace == NULL && !option.paraDelim)
+		return;
 
 	if (charData.singleChar == 0 || charData.singleChar == 1)
 		VECTOR_APPEND(whitespaceBuffer, 1);
@@ -108,6 +208,11 @@ void writeWhitespaceDelimiterSC(InputFile *file) {
 /* UTF-8 versions of the classification and storage routines.
    Descriptions can be found in the definition of the DispatchTable struct. */
 
+/** Get the number of input bytes of the last read grapheme cluster. */
+static size_t clusterBytes(InputFile *file) {
+	return getClusterEnd(file->input) - file->textOffset;
+}
+
 bool getNextCharUTF8(Stream *file) {
 	bool retval = getCluster(file, &charData.UTF8Char.original);
 	if (retval)
@@ -153,6 +258,12 @@ void writeTokenCharUTF8(InputFile *file) {
 		currentWord.used += bytes;
 	}
 
+	if (option.tokenPositions)
+		advancePosition(file, clusterBytes(file), charData.UTF8Char.original.data[0] == '\n', false);
+
+	if (file->tokens == NULL)
+		return;
+
 	/* Write the "original" characters. Note that high and low surrogates
 	   and other invalid characters have been converted to REPLACEMENT
 	   CHARACTER. */
@@ -160,6 +271,8 @@ void writeTokenCharUTF8(InputFile *file) {
 		sputc(file->tokens->stream, 1);
 		sputc(file->tokens->stream, charData.UTF8Char.original.data[0]);
 	} else {
+		if (charData.UTF8Char.original.data[0] == '\n')
+			file->tokenNewlines++;
 		for (i = 0; i < charData.UTF8Char.original.used; i++)
 			putuc(file->tokens->stream, charData.UTF8Char.original.data[i]);
 	}
@@ -169,8 +282,12 @@ void writeWhitespaceCharUTF8(InputFile *file) {
 	UChar32 highSurrogate = 0;
 	size_t i;
 
-	/* Don't want to change interface (yet), so prevent warning. */
-	(void) file;
+	if (option.tokenPositions)
+		advancePosition(file, clusterBytes(file), charData.UTF8Char.original.data[0] == '\n', true);
+
+	/* The whitespace is only needed for its newlines in paragraph delimiter mode. */
+	if (file->whitespace == NULL && !option.paraDelim)
+		return;
 
 	/* 0 and 1 are always considered to be a grapheme cluster on their own, and
 	   are therefore always the only thing in the charData buffer if we
@@ -207,6 +324,32 @@ DEF_TABLE(SC)
 ONLY_UNICODE(DEF_TABLE(UTF8))
 DispatchTable *dispatch = &SCDispatch;
 
+/** Write a piece of whitespace to the whitespace file.
+	@param file The @a InputFile from which the whitespace came.
+	@param data The whitespace to write.
+	@param length The number of bytes in @a data.
+*/
+static void writeWhitespace(InputFile *file, const char *data, size_t length) {
+	size_t i;
+
+	if (file->whitespace == NULL)
+		return;
+	swrite(file->whitespace->stream, data, length);
+	writeWhitespaceDelimiter(file);
+
+	if (!option.context)
+		return;
+	for (i = 0; i < length; i++) {
+		if (data[i] == '\n')
+			file->whitespaceNewlines++;
+	}
+	if (++file->spooledWhitespace % SPOOL_CHECKPOINT_INTERVAL == 0) {
+		SpoolCheckpoint *checkpoint = getCheckpoint(file, file->spooledWhitespace);
+		checkpoint->whitespaceOffset = sftell(file->whitespace->stream);
+		checkpoint->whitespaceNewlines = file->whitespaceNewlines;
+	}
+}
+
 /** Handle the end of a whitespace sequence.
 	@param file The @a InputFile from which the whitespace came.
 
@@ -234,11 +377,8 @@ void handleWhitespaceEnd(InputFile *file) {
 		   whitespace where two newlines are required for an empty line. */
 		if (firstNewlineFound && !tokenWritten) {
 			/* Write everything upto but excluding the first newline */
-			swrite(file->whitespace->stream, whitespaceBuffer.data, firstNewline);
-			writeWhitespaceDelimiter(file);
-
-			swrite(file->whitespace->stream, whitespaceBuffer.data + firstNewline, whitespaceBuffer.used - firstNewline);
-			writeWhitespaceDelimiter(file);
+			writeWhitespace(file, whitespaceBuffer.data, firstNewline);
+			writeWhitespace(file, whitespaceBuffer.data + firstNewline, whitespaceBuffer.used - firstNewline);
 			writeEndOfToken(file);
 			whitespaceBuffer.used = 0;
 			return;
@@ -246,11 +386,8 @@ void handleWhitespaceEnd(InputFile *file) {
 
 		if (i != whitespaceBuffer.used) {
 			/* Write everything upto and including the first newline */
-			swrite(file->whitespace->stream, whitespaceBuffer.data, firstNewline + 1);
-			writeWhitespaceDelimiter(file);
-
-			swrite(file->whitespace->stream, whitespaceBuffer.data + firstNewline + 1, whitespaceBuffer.used - (firstNewline + 1));
-			writeWhitespaceDelimiter(file);
+			writeWhitespace(file, whitespaceBuffer.data, firstNewline + 1);
+			writeWhitespace(file, whitespaceBuffer.data + firstNewline + 1, whitespaceBuffer.used - (firstNewline + 1));
 			writeEndOfToken(file);
 			whitespaceBuffer.used = 0;
 			return;
@@ -258,8 +395,7 @@ void handleWhitespaceEnd(InputFile *file) {
 		/* Fall through to default case */
 	}
 
-	swrite(file->whitespace->stream, whitespaceBuffer.data, whitespaceBuffer.used);
-	writeWhitespaceDelimiter(file);
+	writeWhitespace(file, whitespaceBuffer.data, whitespaceBuffer.used);
 	whitespaceBuffer.used = 0;
 }
 
@@ -271,6 +407,113 @@ int classifyChar(void) {
 	return isDelimiter() ? CAT_DELIMITER : (isWhitespace() ? CAT_WHITESPACE : CAT_OTHER);
 }
 
+/** Read the next character from a file and separate whitespace from the rest.
+	@param file The @a InputFile to read.
+	@param state The state of the reading of @a file.
+	@param wordCount The number of "words" in @a file, which is updated.
+	@return A boolean indicating whether a character was read.
+*/
+static bool tokenizeNextChar(InputFile *file, MatchState *state, int *wordCount) {
+	int category;
+
+	if (!getNextChar(file->input))
+		return false;
+
+	category = classifyChar();
+	switch (*state) {
+		case NONE:
+			if (category == CAT_WHITESPACE) {
+				writeWhitespaceChar(file);
+				*state = WHITESPACE;
+				break;
+			}
+			handleWhitespaceEnd(file);
+			writeTokenChar(file);
+			if (category == CAT_DELIMITER) {
+				writeEndOfToken(file);
+				*state = WHITESPACE;
+			} else {
+				*state = WORD;
+			}
+			break;
+		case WORD:
+			if (category == CAT_WHITESPACE) {
+				/* Found the end of a "word". Go to whitespace mode. */
+				(*wordCount)++;
+				writeEndOfToken(file);
+				writeWhitespaceChar(file);
+				*state = WHITESPACE;
+			} else if (category == CAT_DELIMITER) {
+				/* Found a delimiter. Finish the current word, add a zero length whitespace
+				   to the whitespace file, add the delimiter as a word, and go into
+				   whitespace mode. */
+				*wordCount += 2;
+				writeEndOfToken(file);
+				writeTokenChar(file);
+				writeEndOfToken(file);
+				handleWhitespaceEnd(file);
+				*state = WHITESPACE;
+			} else {
+				writeTokenChar(file);
+			}
+			break;
+		case WHITESPACE:
+			if (category == CAT_WHITESPACE) {
+				writeWhitespaceChar(file);
+			} else if (category == CAT_DELIMITER) {
+				/* Found a delimiter. Finish the current whitespace, and add the delimiter
+				   as a word. Then start new whitespace. */
+				(*wordCount)++;
+				writeTokenChar(file);
+				writeEndOfToken(file);
+				handleWhitespaceEnd(file);
+			} else {
+				/* Found the start of a word. Finish the whitespace, and go into
+				   word mode. */
+				handleWhitespaceEnd(file);
+				writeTokenChar(file);
+				*state = WORD;
+			}
+			break;
+		default:
+			PANIC();
+	}
+	return true;
+}
+
+/** Finish reading a file.
+	@param file The @a InputFile that was read.
+	@param state The state of the reading of @a file.
+	@param wordCount The number of "words" in @a file, which is updated.
+*/
+static void tokenizeEnd(InputFile *file, MatchState state, int *wordCount) {
+	if (sferror(file->input))
+		fatal(_("Error reading file %s: %s\n"), file->name, strerror(sgeterrno(file->input)));
+
+
+	/* Make sure there is whitespace to end the output with. This may
+	   be zero-length. */
+	handleWhitespaceEnd(file);
+
+	/* Make sure the word is terminated, or otherwise diff will add
+	   extra output. */
+	if (state == WORD) {
+		(*wordCount)++;
+		writeEndOfToken(file);
+	}
+	/* Close the input. */
+	file->inputBytes = isFileStream(file->input) ? sftell(file->input) : 0;
+	sfclose(file->input);
+}
+
+/** Open the input of a file, if it is not standard input.
+	@param file The @a InputFile to open.
+*/
+static void openInput(InputFile *file) {
+	if (file->name != NULL && (file->input = newFileStream(fileOpen(file->name, FILE_READ))) == NULL)
+		fatal(_("Can't open file %s: %s\n"), file->name, strerror(errno));
+}
+
 /** Read a file and separate whitespace from the rest.
     @param file The @a InputFile to read.
     @return The number of "words" in @a file.
@@ -286,118 +529,162 @@ int classifyChar(void) {
 static int readFile(InputFile *file) {
 	MatchState state = NONE;
 	int wordCount = 0;
-	int category;
 
-	if (file->name != NULL && (file->input = newFileStream(fileOpen(file->name, FILE_READ))) == NULL)
-		fatal(_("Can't open file %s: %s\n"), file->name, strerror(errno));
+	openInput(file);
 
-	if ((file->tokens = tempFile()) == NULL)
+	/* If nothing is printed, only the diff tokens are needed. */
+	file->tokens = NULL;
+	if (option.spoolInput && (file->tokens = tempFile()) == NULL)
 		fatal(_("Could not create temporary file: %s\n"), strerror(errno));
 
 	VECTOR_INIT(file->diffTokens);
 
-	if ((file->whitespace = tempFile()) == NULL)
+	file->values = NULL;
+	if (option.window != 0 && (file->values = tempFile()) == NULL)
+		fatal(_("Could not create temporary file: %s\n"), strerror(errno));
+
+	file->whitespace = NULL;
+	if (option.spoolInput && (file->whitespace = tempFile()) == NULL)
 		fatal(_("Could not create temporary file: %s\n"), strerror(errno));
 
 	tokenWritten = false;
 
-	while (getNextChar(file->input)) {
-		category = classifyChar();
-		switch (state) {
-			case NONE:
-				if (category == CAT_WHITESPACE) {
-					writeWhitespaceChar(file);
-					state = WHITESPACE;
-					break;
-				}
-				handleWhitespaceEnd(file);
-				writeTokenChar(file);
-				if (category == CAT_DELIMITER) {
-					writeEndOfToken(file);
-					state = WHITESPACE;
-				} else {
-					state = WORD;
-				}
-				break;
-			case WORD:
-				if (category == CAT_WHITESPACE) {
-					/* Found the end of a "word". Go to whitespace mode. */
-					wordCount++;
-					writeEndOfToken(file);
-					writeWhitespaceChar(file);
-					state = WHITESPACE;
-				} else if (category == CAT_DELIMITER) {
-					/* Found a delimiter. Finish the current word, add a zero length whitespace
-					   to the whitespace file, add the delimiter as a word, and go into
-					   whitespace mode. */
-					wordCount += 2;
-					writeEndOfToken(file);
-					writeTokenChar(file);
-					writeEndOfToken(file);
-					handleWhitespaceEnd(file);
-					state = WHITESPACE;
-				} else {
-					writeTokenChar(file);
-				}
-				break;
-			case WHITESPACE:
-				if (category == CAT_WHITESPACE) {
-					writeWhitespaceChar(file);
-				} else if (category == CAT_DELIMITER) {
-					/* Found a delimiter. Finish the current whitespace, and add the delimiter
-					   as a word. Then start new whitespace. */
-					wordCount++;
-					writeTokenChar(file);
-					writeEndOfToken(file);
-					handleWhitespaceEnd(file);
-				} else {
-					/* Found the start of a word. Finish the whitespace, and go into
-					   word mode. */
-					handleWhitespaceEnd(file);
-					writeTokenChar(file);
-					state = WORD;
-				}
-				break;
-			default:
-				PANIC();
-		}
+	file->checkpoints.used = 0;
+	file->spooledTokens = file->spooledWhitespace = 0;
+	file->tokenNewlines = file->whitespaceNewlines = 0;
+	if (option.context && file->tokens != NULL)
+		getCheckpoint(file, 0);
+
+	file->positions.used = 0;
+	file->textOffset = file->tokenOffset = 0;
+	file->textLine = file->lastByteLine = file->tokenLine = 1;
+
+	while (tokenizeNextChar(file, &state, &wordCount)) {}
+	tokenizeEnd(file, state, &wordCount);
+
+	/* Make sure the output is in the filesystem. Then rewind so we can start
+	   reading from the start. */
+	if (file->whitespace != NULL) {
+		sfflush(file->whitespace->stream);
+		if (sferror(file->whitespace->stream))
+			fatal(_("Error writing to temporary file %s: %s\n"), file->name, strerror(sgeterrno(file->whitespace->stream)));
+		srewind(file->whitespace->stream);
 	}
 
-	if (sferror(file->input))
-		fatal(_("Error reading file %s: %s\n"), file->name, strerror(sgeterrno(file->input)));
+	if (file->tokens != NULL) {
+		sfflush(file->tokens->stream);
+		if (sferror(file->tokens->stream))
+			fatal(_("Error writing to temporary file %s: %s\n"), file->name, strerror(sgeterrno(file->tokens->stream)));
+		srewind(file->tokens->stream);
+	}
 
+	if (file->values != NULL) {
+		sfflush(file->values->stream);
+		if (sferror(file->values->stream))
+			fatal(_("Error writing to temporary file %s: %s\n"), file->name, strerror(sgeterrno(file->values->stream)));
+		srewind(file->values->stream);
+	}
 
-	/* Make sure there is whitespace to end the output with. This may
-	   be zero-length. */
-	handleWhitespaceEnd(file);
+	return wordCount;
+}
 
-	/* Make sure the word is terminated, or otherwise diff will add
-	   extra output. */
-	if (state == WORD) {
-		wordCount++;
-		writeEndOfToken(file);
+/** Read from a file until at least one token is available for comparison, for --brief.
+	@param file The @a BriefFile to read.
+*/
+static void readBriefToken(BriefFile *file) {
+	if (file->lengths.used != 0 || file->atEnd)
+		return;
+
+	currentWord = file->word;
+	whitespaceBuffer = file->whitespace;
+	tokenWritten = file->tokenWritten;
+	briefFile = file;
+
+	while (file->lengths.used == 0) {
+		if (!tokenizeNextChar(file->file, &file->state, &file->wordCount)) {
+			tokenizeEnd(file->file, file->state, &file->wordCount);
+			file->atEnd = true;
+			break;
+		}
 	}
-	/* Close the input, and make sure the output is in the filesystem.
-	   Then rewind so we can start reading from the start. */
-	sfclose(file->input);
 
-	sfflush(file->whitespace->stream);
-	if (sferror(file->whitespace->stream))
-		fatal(_("Error writing to temporary file %s: %s\n"), file->name, strerror(sgeterrno(file->whitespace->stream)));
-	srewind(file->whitespace->stream);
+	briefFile = NULL;
+	file->word = currentWord;
+	file->whitespace = whitespaceBuffer;
+	file->tokenWritten = tokenWritten;
+}
 
-	sfflush(file->tokens->stream);
-	if (sferror(file->tokens->stream))
-		fatal(_("Error writing to temporary file %s: %s\n"), file->name, strerror(sgeterrno(file->tokens->stream)));
-	srewind(file->tokens->stream);
+/** Remove the first token available for comparison, for --brief.
+	@param file The @a BriefFile to remove the token from.
+*/
+static void dropBriefToken(BriefFile *file) {
+	size_t length = file->lengths.data[0];
 
-	return wordCount;
+	file->tokens.used -= length;
+	memmove(file->tokens.data, file->tokens.data + length, file->tokens.used);
+	file->lengths.used--;
+	memmove(file->lengths.data, file->lengths.data + 1, file->lengths.used * sizeof(file->lengths.data[0]));
+}
+
+/** Check whether the input files contain different words, for --brief.
+	@return A boolean indicating whether the files differ.
+
+	The files are read in lockstep, and reading stops at the first word that
+	differs. No temporary files are created and no diff is computed.
+*/
+static bool briefCompare(void) {
+	BriefFile files[2];
+	bool differ;
+	int i;
+
+	memset(files, 0, sizeof(files));
+	files[0].file = &option.oldFile;
+	files[1].file = &option.newFile;
+	for (i = 0; i < 2; i++) {
+		files[i].state = NONE;
+		files[i].file->tokens = files[i].file->whitespace = files[i].file->values = NULL;
+		VECTOR_INIT(files[i].file->diffTokens);
+		openInput(files[i].file);
+	}
+
+	while (true) {
+		readBriefToken(&files[0]);
+		readBriefToken(&files[1]);
+		if (files[0].lengths.used == 0 || files[1].lengths.used == 0) {
+			differ = files[0].lengths.used != files[1].lengths.used;
+			break;
+		}
+		if (files[0].lengths.data[0] != files[1].lengths.data[0] ||
+				memcmp(files[0].tokens.data, files[1].tokens.data, files[0].lengths.data[0]) != 0) {
+			differ = true;
+			break;
+		}
+		dropBriefToken(&files[0]);
+		dropBriefToken(&files[1]);
+	}
+
+	/* The buffers in use by currentWord and whitespaceBuffer are freed below. */
+	VECTOR_INIT(currentWord);
+	VECTOR_INIT(whitespaceBuffer);
+	for (i = 0; i < 2; i++) {
+		VECTOR_FREE(files[i].word);
+		VECTOR_FREE(files[i].whitespace);
+		VECTOR_FREE(files[i].tokens);
+		VECTOR_FREE(files[i].lengths);
+	}
+	return differ;
 }
 
 /** Read the input files and perform the diff. */
 static void prepareAndExecuteDiff(void) {
+	phaseStart(PHASE_READ_OLD);
 	statistics.oldTotal = readFile(&option.oldFile);
+	phaseCount(PHASE_READ_OLD, option.oldFile.inputBytes, statistics.oldTotal);
+	phaseEnd(PHASE_READ_OLD);
+	phaseStart(PHASE_READ_NEW);
 	statistics.newTotal = readFile(&option.newFile);
+	phaseCount(PHASE_READ_NEW, option.newFile.inputBytes, statistics.newTotal);
+	phaseEnd(PHASE_READ_NEW);
 	baseHashMax = getHashMax();
 
 	/* Whitespace buffer and currentWord won't be used after this. */
@@ -417,6 +704,14 @@ typedef enum {
 	LINE_COUNTS
 } DiffInputMode;
 
+/** Copy a character of the diff headers to the output, unless only statistics are printed. */
+static void putHeaderChar(int c) {
+	char byte = c;
+
+	if (!option.similarity)
+		outputWrite(&byte, 1);
+}
+
 /** Split the input, if it is the output from diff -u or similar. */
 void splitDiffInput(void) {
 	Stream *input;
@@ -436,7 +731,7 @@ void splitDiffInput(void) {
 	while (getNextCharSC(input)) {
 		switch (mode) {
 			case FIRST_HEADER:
-				putchar(charData.singleChar);
+				putHeaderChar(charData.singleChar);
 				mode = charData.singleChar != '@' ? HEADER : LINE_COUNTS;
 				break;
 			case FIRST:
@@ -464,7 +759,7 @@ void splitDiffInput(void) {
 					oldFile = tempFile();
 					newFile = tempFile();
 
-					putchar(savedChar);
+					putHeaderChar(savedChar);
 					mode = savedChar == '@' ? LINE_COUNTS : HEADER;
 				}
 				break;
@@ -486,13 +781,13 @@ void splitDiffInput(void) {
 				break;
 
 			case HEADER:
-				putchar(charData.singleChar);
+				putHeaderChar(charData.singleChar);
 				if (charData.singleChar == '\n')
 					mode = FIRST_HEADER;
 				break;
 
 			case LINE_COUNTS:
-				putchar(charData.singleChar);
+				putHeaderChar(charData.singleChar);
 				if (charData.singleChar == '\n')
 					mode = FIRST;
 				break;
@@ -509,6 +804,60 @@ void splitDiffInput(void) {
 	prepareAndExecuteDiff();
 }
 
+/** Print the word counts of the old and new file.
+	@param stream The stream to print to.
+*/
+static void printStatistics(FILE *stream) {
+	int common = statistics.oldTotal - statistics.deleted - statistics.oldChanged;
+	if (statistics.oldTotal == 0) {
+		fprintf(stream, _("old: 0 words\n"));
+	} else {
+		fprintf(stream, _("old: %d words  %d %d%% common  %d %d%% deleted  %d %d%% changed\n"), statistics.oldTotal,
+			common, (common * 100)/statistics.oldTotal,
+			statistics.deleted, (statistics.deleted * 100) / statistics.oldTotal,
+			statistics.oldChanged, (statistics.oldChanged * 100) / statistics.oldTotal);
+	}
+	common = statistics.newTotal - statistics.added - statistics.newChanged;
+	if (statistics.newTotal == 0) {
+		fprintf(stream, _("new: 0 words\n"));
+	} else {
+		fprintf(stream, _("new: %d words  %d %d%% common  %d %d%% inserted  %d %d%% changed\n"), statistics.newTotal,
+			common, (common * 100)/statistics.newTotal,
+			statistics.added, (statistics.added * 100) / statistics.newTotal,
+			statistics.newChanged, (statistics.newChanged * 100) / statistics.newTotal);
+	}
+}
+
+/** Print the outputs requested with --emit. */
+static void printEmitTargets(void) {
+	option_t given = option;
+	size_t i;
+
+	for (i = 0; i < emitTargets.used; i++) {
+		EmitTarget *target = &emitTargets.data[i];
+		bool useStdout = strcmp(target->path, "-") == 0;
+
+		option = target->options;
+		option.oldFile = given.oldFile;
+		option.newFile = given.newFile;
+		if (useStdout)
+			option.output = stdout;
+		else if ((option.output = fopen(target->path, "w")) == NULL)
+			fatal(_("Can't open output file %s: %s\n"), target->path, strerror(errno));
+
+		if (target->format == EMIT_STATS)
+			printStatistics(option.output);
+		else
+			printDiff();
+
+		if (fflush(option.output) != 0 || ferror(option.output) || (!useStdout && fclose(option.output) != 0))
+			fatal(_("Error writing output file %s: %s\n"), target->path, strerror(errno));
+		given.oldFile = option.oldFile;
+		given.newFile = option.newFile;
+	}
+	option = given;
+}
+
 /** Main. */
 int main(int argc, char *argv[]) {
 #if defined(USE_GETTEXT) || defined(USE_UNICODE)
@@ -562,40 +911,44 @@ int main(int argc, char *argv[]) {
 	VECTOR_INIT(currentWord);
 
 	parseCmdLine(argc, argv);
+	if (option.profilePhases != PHASES_NONE)
+		initPhases();
 
 	VECTOR_INIT(whitespaceBuffer);
 
 	/* If we are reading the output from diff -u, then we need to first split
 	   the input into two separate files. After that, we can use our normal
 	   algorithm for determining the difference between two files. */
-	if (option.diffInput)
+	if (option.brief)
+		differences = briefCompare();
+	else if (option.diffInput)
 		splitDiffInput();
 	else
 		prepareAndExecuteDiff();
 
+	if (emitTargets.used != 0)
+		printEmitTargets();
+
+	phaseStart(PHASE_OUTPUT);
+	outputFlush();
+	phaseEnd(PHASE_OUTPUT);
+	if (option.similarity)
+		printStatistics(option.output);
 	fflush(option.output);
 
 	if (option.statistics) {
-		int common = statistics.oldTotal - statistics.deleted - statistics.oldChanged;
-		if (statistics.oldTotal == 0) {
-			fprintf(stderr, _("old: 0 words\n"));
-		} else {
-			fprintf(stderr, _("old: %d words  %d %d%% common  %d %d%% deleted  %d %d%% changed\n"), statistics.oldTotal,
-				common, (common * 100)/statistics.oldTotal,
-				statistics.deleted, (statistics.deleted * 100) / statistics.oldTotal,
-				statistics.oldChanged, (statistics.oldChanged * 100) / statistics.oldTotal);
-		}
-		common = statistics.newTotal - statistics.added - statistics.newChanged;
-		if (statistics.newTotal == 0) {
-			fprintf(stderr, _("new: 0 words\n"));
-		} else {
-			fprintf(stderr, _("new: %d words  %d %d%% common  %d %d%% inserted  %d %d%% changed\n"), statistics.newTotal,
-				common, (common * 100)/statistics.newTotal,
-				statistics.added, (statistics.added * 100) / statistics.newTotal,
-				statistics.newChanged, (statistics.newChanged * 100) / statistics.newTotal);
-		}
+		if (!option.similarity)
+			printStatistics(stderr);
+		if (diff_approximations != 0)
+			fprintf(stderr, _("diff: %ld comparisons  %ld approximated because of --max-diff-time/--max-diff-memory\n"),
+				(long) diff_comparisons, (long) diff_approximations);
+	} else if (diff_approximations != 0) {
+		fprintf(stderr, _("Warning: diff budget exhausted, changes have been approximated\n"));
 	}
 
+	if (option.profilePhases != PHASES_NONE)
+		printPhases(stderr, option.profilePhases == PHASES_JSON);
+
 #ifdef DEBUG_MEMORY
 	free(option.oldFile.diffTokens.data);
 	free(option.newFile.diffTokens.data);
@@ -606,6 +959,10 @@ int main(int argc, char *argv[]) {
 #endif
 	free(option.delColor);
 	free(option.addColor);
+	free(option.moveDelColor);
+	free(option.moveAddColor);
+	free(option.oldFile.moveState);
+	free(option.newFile.moveState);
 #endif
 	return differences;
 }
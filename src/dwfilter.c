@@ -99,6 +99,14 @@ static PARSE_FUNCTION(parseCmdLine)
 		BOOLEAN_LONG_OPTION("aggregate-changes", discard)
 		OPTION('A', "algorithm", REQUIRED_ARG)
 		END_OPTION
+		LONG_OPTION("max-diff-time", REQUIRED_ARG)
+		END_OPTION
+		LONG_OPTION("max-diff-memory", REQUIRED_ARG)
+		END_OPTION
+		LONG_OPTION("align-chunks", OPTIONAL_ARG)
+		END_OPTION
+		LONG_OPTION("window", OPTIONAL_ARG)
+		END_OPTION
 		BOOLEAN_LONG_OPTION("wdiff-output", discard)
 		/* FIXME: make this work again, after fixing dwdiff */
 /* 		OPTION('S', "paragraph-separator", OPTIONAL_ARG)
@@ -40,6 +40,7 @@ File *fileWrapFD(int fd, FileMode mode) {
 	retval->errNo = 0;
 	retval->bufferFill = 0;
 	retval->bufferIndex = 0;
+	retval->offset = 0;
 	retval->eof = EOF_NO;
 	retval->mode = mode;
 	retval->vtable = &vtableReal;
@@ -112,6 +113,7 @@ int fileGetc(File *file) {
 			file->eof = EOF_HIT;
 			return EOF;
 		}
+		file->offset += file->bufferFill;
 		file->bufferFill = bytesRead;
 		file->bufferIndex = 0;
 	}
@@ -159,6 +161,7 @@ static int flushBuffer(File *file) {
 		}
 	}
 
+	file->offset += bytesWritten;
 	file->bufferFill = 0;
 	return bytesWritten;
 }
@@ -250,11 +253,34 @@ int fileRewind(File *file, FileMode mode) {
 		file->errNo = errno;
 		return -1;
 	}
+	file->offset = 0;
 	file->eof = EOF_NO;
 	file->mode = mode;
 	return 0;
 }
 
+/** Get the current position in a @a File. */
+off_t fileTell(File *file) {
+	return file->offset + (file->mode == FILE_WRITE ? file->bufferFill : file->bufferIndex);
+}
+
+/** Set the read position of a @a File. */
+int fileSeek(File *file, off_t offset) {
+	ASSERT(file->mode == FILE_READ);
+	if (file->errNo != 0)
+		return -1;
+
+	if (lseek(file->fd, offset, SEEK_SET) < 0) {
+		file->errNo = errno;
+		return -1;
+	}
+	file->offset = offset;
+	file->bufferFill = 0;
+	file->bufferIndex = 0;
+	file->eof = EOF_NO;
+	return 0;
+}
+
 /** Return if a @a File is in error state. */
 int fileError(File *file) {
 	return file->errNo != 0;
@@ -15,6 +15,7 @@
 #ifndef FILE_H
 #define FILE_H
 
+#include <sys/types.h>
 #include "buffer.h"
 
 /* Note: files opened for write can also be read. However, not vice versa. */
@@ -51,6 +52,8 @@ typedef struct File {
 	int bufferFill;
 	/* Current index in the buffer. */
 	int bufferIndex;
+	/* Offset in the file of the start of the buffer. */
+	off_t offset;
 
 	/* Flag to indicate whether filling the buffer hit end of file. */
 	EOFState eof;
@@ -78,6 +81,8 @@ int fileUngetc(File *file, int c);
 int fileClose(File *file);
 int filePuts(File *file, const char *string);
 int fileRewind(File *file, FileMode mode);
+off_t fileTell(File *file);
+int fileSeek(File *file, off_t offset);
 int fileError(File *file);
 int fileGetErrno(File *file);
 int fileEof(File *file);
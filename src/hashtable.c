@@ -43,6 +43,7 @@ static Tuple *hashtable[HASHTABLE_SIZE];
 static ValueType nextValue;
 
 ValueType baseHashMax;
+HashStatistics hashStatistics;
 
 static Tuple *allocFromBlock(size_t size) {
 	Tuple *result;
@@ -75,18 +76,6 @@ static void freeBlocks(void) {
 	}
 }
 
-#ifdef PROFILE_HASH
-static int collisions;
-static int hits;
-
-void printHashStatistics(void) {
-	fprintf(stderr, "Hash statistics: unique words: %d, collisions %d (%.2f%%), hits %d\n",
-		(int) nextValue, collisions, (double) collisions * 100.0 / nextValue, hits);
-	collisions = 0;
-	hits = 0;
-}
-#endif
-
 /** Calculate a hash value for a string.
 	@param key The string to hash.
 	@return The hash value associated with the string.
@@ -125,12 +114,11 @@ ValueType getValue(void *data, size_t size) {
 	while (tuple != NULL && !(size == tuple->stringLength && memcmp(data, tuple->string, size) == 0))
 		tuple = tuple->next;
 
+	hashStatistics.lookups++;
 	if (tuple == NULL) {
 		ASSERT(nextValue != VALUE_MAX);
-		#ifdef PROFILE_HASH
 		if (hashtable[hashValue] != NULL)
-			collisions++;
-		#endif
+			hashStatistics.collisions++;
 		tuple = allocFromBlock(sizeof(Tuple) - 1 + size);
 
 		tuple->value = nextValue++;
@@ -139,10 +127,8 @@ ValueType getValue(void *data, size_t size) {
 		tuple->next = hashtable[hashValue];
 		hashtable[hashValue] = tuple;
 	}
-	#ifdef PROFILE_HASH
 	else
-		hits++;
-	#endif
+		hashStatistics.hits++;
 	return tuple->value;
 }
 
@@ -150,10 +136,6 @@ ValueType getHashMax(void) {
 	ValueType hashMax = nextValue;
 	int i;
 
-	#ifdef PROFILE_HASH
-	printHashStatistics();
-	#endif
-
 	/* Reset the hashtable for the next iteration. */
 	for (i = 0; i < HASHTABLE_SIZE; i++)
 		hashtable[i] = NULL;
@@ -19,9 +19,18 @@
 #include "definitions.h"
 #include "buffer.h"
 
+/* Counts of the lookups in the hash table, for --profile-phases. */
+typedef struct {
+	/* The number of lookups, and the number of lookups which found an existing word. */
+	unsigned long lookups, hits;
+	/* The number of new words which were added to a non-empty bucket. */
+	unsigned long collisions;
+} HashStatistics;
+
 ValueType getValueFromContext(CharBuffer *word);
 ValueType getValue(void *data, size_t size);
 ValueType getHashMax(void);
 
 extern ValueType baseHashMax;
+extern HashStatistics hashStatistics;
 #endif
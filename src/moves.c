@@ -0,0 +1,181 @@
+/* Copyright (C) 2026 agent <agent@local>
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License version 3, as
+   published by the Free Software Foundation.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/* Detection of blocks of text that were moved, rather than deleted in one
+   place and inserted in another. The inserted text is indexed by hashing all
+   runs of minLength tokens. The deleted text is then scanned for runs that
+   occur in the index. A match is extended for as long as both sides continue
+   to agree, and the matching tokens are marked as moved on both sides. Each
+   inserted token can be part of only one move.
+
+   Because every run is found through the index rather than by comparing all
+   pairs of changes, the time needed is linear in the number of changed tokens
+   for all practical purposes. */
+
+#include <stdlib.h>
+#include <string.h>
+#include "definitions.h"
+#include "option.h"
+#include "util.h"
+#include "moves.h"
+
+/* Multiplier for the rolling hash. */
+#define HASH_MULTIPLIER UINT64_C(0x100000001b3)
+/* Maximum number of candidates to try for a single run. This bounds the time
+   spent on highly repetitive text. */
+#define MAX_CHAIN 32
+
+typedef uint64_t Hash;
+
+/** Allocate, or reallocate, the moveState array of @a file and mark the
+    tokens that are part of a change.
+	@param file The @a InputFile to set up.
+	@param script The edit script.
+	@param old Whether @a file is the old file.
+*/
+static void initMoveState(InputFile *file, const ChangeVector *script, bool old) {
+	size_t i;
+
+	free(file->moveState);
+	/* Allocate one extra element, such that runs can be extended without
+	   checking for the end of the file. */
+	file->moveState = safe_calloc(file->diffTokens.used + 1);
+
+	for (i = 0; i < script->used; i++) {
+		const struct change *change = script->data + i;
+		if (old)
+			memset(file->moveState + change->line0, MOVE_CANDIDATE, change->deleted);
+		else
+			memset(file->moveState + change->line1, MOVE_CANDIDATE, change->inserted);
+	}
+}
+
+/** Compute the hash of @a length tokens. */
+static Hash hashRun(const ValueType *tokens, unsigned length) {
+	Hash hash = 0;
+	unsigned i;
+
+	for (i = 0; i < length; i++)
+		hash = hash * HASH_MULTIPLIER + (Hash) tokens[i];
+	return hash;
+}
+
+/** Detect moved blocks of text.
+	@param script The final edit script.
+	@param minLength The minimum number of tokens in a moved block.
+
+	On return, the moveState arrays of both input files contain
+	@a MOVE_MOVED for all tokens that are part of a moved block.
+*/
+void detectMoves(const ChangeVector *script, unsigned minLength) {
+	const ValueType *oldTokens = option.oldFile.diffTokens.data, *newTokens = option.newFile.diffTokens.data;
+	char *oldState, *newState;
+	lin *heads, *next;
+	size_t i, runs = 0, headsSize;
+	Hash mask, outFactor = 1;
+
+	initMoveState(&option.oldFile, script, true);
+	initMoveState(&option.newFile, script, false);
+	oldState = option.oldFile.moveState;
+	newState = option.newFile.moveState;
+
+	for (i = 0; i < script->used; i++) {
+		if ((size_t) script->data[i].inserted >= minLength)
+			runs += script->data[i].inserted - minLength + 1;
+	}
+	if (runs == 0)
+		return;
+
+	/* Index the inserted text. The hash table has chained entries, where the
+	   chains are stored by token position. */
+	for (headsSize = 64; headsSize < 2 * runs; headsSize *= 2) {}
+	mask = headsSize - 1;
+	heads = safe_malloc(headsSize * sizeof(lin));
+	for (i = 0; i < headsSize; i++)
+		heads[i] = -1;
+	next = safe_malloc(option.newFile.diffTokens.used * sizeof(lin));
+
+	for (i = 1; i < minLength; i++)
+		outFactor *= HASH_MULTIPLIER;
+
+	for (i = 0; i < script->used; i++) {
+		const struct change *change = script->data + i;
+		lin pos, end = change->line1 + change->inserted - minLength;
+		Hash hash;
+
+		if ((size_t) change->inserted < minLength)
+			continue;
+
+		hash = hashRun(newTokens + change->line1, minLength);
+		for (pos = change->line1; ; pos++) {
+			next[pos] = heads[hash & mask];
+			heads[hash & mask] = pos;
+			if (pos == end)
+				break;
+			hash = (hash - outFactor * (Hash) newTokens[pos]) * HASH_MULTIPLIER + (Hash) newTokens[pos + minLength];
+		}
+	}
+
+	/* Scan the deleted text for runs that occur in the inserted text. */
+	for (i = 0; i < script->used; i++) {
+		const struct change *change = script->data + i;
+		lin pos = change->line0, end = change->line0 + change->deleted;
+		bool rehash = true;
+		Hash hash = 0;
+
+		while (pos + (lin) minLength <= end) {
+			lin candidate, length = 0;
+			int chain;
+
+			if (rehash) {
+				hash = hashRun(oldTokens + pos, minLength);
+				rehash = false;
+			}
+
+			for (candidate = heads[hash & mask], chain = 0; candidate >= 0 && chain < MAX_CHAIN;
+					candidate = next[candidate], chain++)
+			{
+				/* Runs which start in tokens that are already part of a move, can
+				   only be matched partially. Skip those, the rest of the run will
+				   be found at a later position if it is long enough. */
+				if (newState[candidate] != MOVE_CANDIDATE || newState[candidate + minLength - 1] != MOVE_CANDIDATE)
+					continue;
+				if (memcmp(oldTokens + pos, newTokens + candidate, minLength * sizeof(ValueType)) != 0)
+					continue;
+				for (length = 0; length < (lin) minLength && newState[candidate + length] == MOVE_CANDIDATE; length++) {}
+				if (length < (lin) minLength)
+					continue;
+				/* Extend the match as far as possible. */
+				while (pos + length < end && newState[candidate + length] == MOVE_CANDIDATE &&
+						oldTokens[pos + length] == newTokens[candidate + length])
+					length++;
+				break;
+			}
+
+			if (length >= (lin) minLength) {
+				memset(oldState + pos, MOVE_MOVED, length);
+				memset(newState + candidate, MOVE_MOVED, length);
+				pos += length;
+				rehash = true;
+			} else {
+				if (pos + (lin) minLength < end)
+					hash = (hash - outFactor * (Hash) oldTokens[pos]) * HASH_MULTIPLIER + (Hash) oldTokens[pos + minLength];
+				pos++;
+			}
+		}
+	}
+
+	free(heads);
+	free(next);
+}
@@ -0,0 +1,31 @@
+/* Copyright (C) 2026 agent <agent@local>
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License version 3, as
+   published by the Free Software Foundation.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef MOVES_H
+#define MOVES_H
+
+#include "definitions.h"
+
+/* Values for the InputFile moveState array. */
+enum {
+	MOVE_NONE,
+	MOVE_CANDIDATE, /* Deleted or inserted, but not (yet) found to be moved. */
+	MOVE_MOVED
+};
+
+#define DEFAULT_MOVE_LENGTH 8
+
+void detectMoves(const ChangeVector *script, unsigned minLength);
+
+#endif
@@ -24,11 +24,13 @@
 #include "buffer.h"
 #include "dispatch.h"
 #include "profile.h"
+#include "moves.h"
 
 #define DWDIFF_COMPILE
 #include "optionDescriptions.h"
 
 option_t option;
+EmitTargetVector emitTargets;
 
 typedef struct {
 	const char *name;
@@ -235,6 +237,14 @@ static void noDefaultMarkers(void) {
 		option.delStart = "";
 	if (option.delStop == NULL)
 		option.delStop = "";
+	if (option.moveAddStart == NULL)
+		option.moveAddStart = "";
+	if (option.moveAddStop == NULL)
+		option.moveAddStop = "";
+	if (option.moveDelStart == NULL)
+		option.moveDelStart = "";
+	if (option.moveDelStop == NULL)
+		option.moveDelStop = "";
 }
 
 
@@ -483,6 +493,10 @@ static void initializeOptions(void) {
 static void completeDefaults(void) {
 	/* Check and set some values */
 	if (!option.dwfilterMode) {
+		/* The markers are not printed by default when the changes are
+		   already distinguished in another way. */
+		if (option.colorMode || option.printer || option.less)
+			noDefaultMarkers();
 		if (option.delStart == NULL) {
 			option.delStart = "[-";
 			option.delStartLen = 2;
@@ -499,6 +513,30 @@ static void completeDefaults(void) {
 			option.addStop = "+}";
 			option.addStopLen = 2;
 		}
+		if (option.moveDelStart == NULL) {
+			option.moveDelStart = "[<";
+			option.moveDelStartLen = 2;
+		}
+		if (option.moveDelStop == NULL) {
+			option.moveDelStop = ">]";
+			option.moveDelStopLen = 2;
+		}
+		if (option.moveAddStart == NULL) {
+			option.moveAddStart = "{>";
+			option.moveAddStartLen = 2;
+		}
+		if (option.moveAddStop == NULL) {
+			option.moveAddStop = "<}";
+			option.moveAddStopLen = 2;
+		}
+		if (option.colorMode && option.moveDelColor == NULL) {
+			option.moveDelColor = parseColor("bmagenta");
+			option.moveAddColor = parseColor("bcyan");
+		}
+		if (option.moveDelColor != NULL) {
+			option.moveDelColorLen = strlen(option.moveDelColor);
+			option.moveAddColorLen = strlen(option.moveAddColor);
+		}
 
 		if (!option.printCommon && !option.printAdded && !option.printDeleted)
 			option.needMarkers = false;
@@ -515,6 +553,7 @@ static void completeDefaults(void) {
 		option.addStop = "";
 		option.addStopLen = 0;
 		option.printAdded = false;
+		option.detectMoves = 0;
 		option.needMarkers = false;
 		option.needStartStop = true;
 	}
@@ -600,25 +639,32 @@ static PARSE_FUNCTION(parseArgs)
 				option.statistics = true;
 			}
 		END_OPTION
+		LONG_OPTION("similarity", NO_ARG)
+			if (!option.dwfilterMode) {
+				option.similarity = true;
+			}
+		END_OPTION
+		OPTION('q', "brief", NO_ARG)
+			if (!option.dwfilterMode) {
+				option.brief = true;
+			}
+		END_OPTION
 		OPTION('a', "autopager", NO_ARG)
 			fatal(_("Option %.*s is not supported\n"), OPTPRARG);
 		END_OPTION
 		OPTION('p', "printer", NO_ARG)
 			if (!option.dwfilterMode) {
 				option.printer = true;
-				noDefaultMarkers();
 			}
 		END_OPTION
 		OPTION('l', "less-mode", NO_ARG)
 			if (!option.dwfilterMode) {
 				option.less = true;
-				noDefaultMarkers();
 			}
 		END_OPTION
 		LONG_OPTION("less", NO_ARG)
 			if (!option.dwfilterMode) {
 				option.less = true;
-				noDefaultMarkers();
 				fprintf(stderr, "WARNING: the --less argument is deprecated. Use --less-mode instead.\n");
 			}
 		END_OPTION
@@ -641,6 +687,41 @@ static PARSE_FUNCTION(parseArgs)
 			option.addStopLen = parseEscapes(optArg, "stop-insert");
 			option.addStop = optArg;
 		END_OPTION
+		LONG_OPTION("detect-moves", OPTIONAL_ARG)
+			if (optArg != NULL)
+				PARSE_INT(option.detectMoves, 2, INT_MAX);
+			else
+				option.detectMoves = DEFAULT_MOVE_LENGTH;
+		END_OPTION
+		LONG_OPTION("start-move-delete", REQUIRED_ARG)
+			option.moveDelStartLen = parseEscapes(optArg, "start-move-delete");
+			option.moveDelStart = optArg;
+		END_OPTION
+		LONG_OPTION("stop-move-delete", REQUIRED_ARG)
+			option.moveDelStopLen = parseEscapes(optArg, "stop-move-delete");
+			option.moveDelStop = optArg;
+		END_OPTION
+		LONG_OPTION("start-move-insert", REQUIRED_ARG)
+			option.moveAddStartLen = parseEscapes(optArg, "start-move-insert");
+			option.moveAddStart = optArg;
+		END_OPTION
+		LONG_OPTION("stop-move-insert", REQUIRED_ARG)
+			option.moveAddStopLen = parseEscapes(optArg, "stop-move-insert");
+			option.moveAddStop = optArg;
+		END_OPTION
+		LONG_OPTION("move-color", REQUIRED_ARG)
+			if (!option.dwfilterMode) {
+				comma = strchr(optArg, ',');
+				if (comma != NULL && strrchr(optArg, ',') != comma)
+					fatal(_("Invalid color specification %s\n"), optArg);
+
+				if (comma != NULL)
+					*comma++ = 0;
+
+				option.moveDelColor = parseColor(optArg[0] == 0 ? "bmagenta" : optArg);
+				option.moveAddColor = parseColor(comma == NULL ? "bcyan" : comma);
+			}
+		END_OPTION
 		OPTION('n', "avoid-wraps", NO_ARG)
 			fatal(_("Option %.*s is not supported\n"), OPTPRARG);
 		END_OPTION
@@ -696,7 +777,6 @@ static PARSE_FUNCTION(parseArgs)
 				}
 				option.delColorLen = strlen(option.delColor);
 				option.addColorLen = strlen(option.addColor);
-				noDefaultMarkers();
 			}
 		END_OPTION
 		OPTION('L', "line-numbers", OPTIONAL_ARG)
@@ -725,6 +805,7 @@ static PARSE_FUNCTION(parseArgs)
 			}
 		END_OPTION
 		BOOLEAN_LONG_OPTION("wdiff-output", option.wdiffOutput)
+		BOOLEAN_LONG_OPTION("incremental", option.incremental)
 		LONG_OPTION("dwfilter", REQUIRED_ARG)
 			/* START_KEEP */
 			option.dwfilterMode = true;
@@ -747,19 +828,97 @@ static PARSE_FUNCTION(parseArgs)
 			}
 		END_OPTION
 		OPTION('A', "algorithm", REQUIRED_ARG)
-			if (strcmp(optArg, "best") == 0) {
-				minimal = true;
-				speed_large_files = false;
+			if (strcmp(optArg, "auto") == 0) {
+				diff_algorithm = DIFF_AUTO;
+			} else if (strcmp(optArg, "best") == 0) {
+				diff_algorithm = DIFF_BEST;
 			} else if (strcmp(optArg, "normal") == 0) {
-				minimal = false;
-				speed_large_files = false;
+				diff_algorithm = DIFF_NORMAL;
 			} else if (strcmp(optArg, "fast") == 0) {
-				minimal = false;
-				speed_large_files = true;
+				diff_algorithm = DIFF_FAST;
 			} else {
 				fatal(_("Invalid algorithm name\n"));
 			}
 		END_OPTION
+		LONG_OPTION("max-diff-time", REQUIRED_ARG)
+			PARSE_INT(max_diff_time, 0, INT_MAX);
+		END_OPTION
+		LONG_OPTION("max-diff-memory", REQUIRED_ARG)
+			int megabytes;
+			PARSE_INT(megabytes, 0, INT_MAX);
+			max_diff_memory = (size_t) megabytes << 20;
+		END_OPTION
+		LONG_OPTION("align-chunks", OPTIONAL_ARG)
+			int size = DEFAULT_ALIGN_CHUNK_SIZE;
+			if (optArg != NULL)
+				PARSE_INT(size, 16, 1 << 24);
+			/* The chunk size must be a power of two. */
+			for (align_chunk_size = 16; align_chunk_size < size; align_chunk_size <<= 1) {}
+		END_OPTION
+		LONG_OPTION("window", OPTIONAL_ARG)
+			int size = DEFAULT_WINDOW_SIZE;
+			if (optArg != NULL)
+				PARSE_INT(size, MIN_WINDOW_SIZE, INT_MAX);
+			option.window = size;
+		END_OPTION
+#ifdef USE_THREADS
+		LONG_OPTION("output-buffers", OPTIONAL_ARG)
+			option.outputBuffers = DEFAULT_OUTPUT_BUFFERS;
+			if (optArg != NULL)
+				PARSE_INT(option.outputBuffers, 2, MAX_OUTPUT_BUFFERS);
+#else
+		LONG_OPTION("output-buffers", OPTIONAL_ARG)
+			fatal(_("Support for option %.*s is not compiled into this version of dwdiff\n"), OPTPRARG);
+#endif
+		END_OPTION
+		LONG_OPTION("profile-phases", OPTIONAL_ARG)
+			if (optArg == NULL || strcmp(optArg, "text") == 0)
+				option.profilePhases = PHASES_TEXT;
+			else if (strcmp(optArg, "json") == 0)
+				option.profilePhases = PHASES_JSON;
+			else
+				fatal(_("Invalid profile format %s\n"), optArg);
+		END_OPTION
+		LONG_OPTION("emit", REQUIRED_ARG)
+			static const char *formats[] = { "markers", "color", "stats", "json", "json,text", "binary", NULL };
+			EmitTarget target;
+			char *colon;
+
+			if (option.dwfilterMode)
+				fatal(_("Option %.*s is not supported\n"), OPTPRARG);
+			if ((colon = strchr(optArg, ':')) == NULL || colon[1] == 0)
+				fatal(_("Invalid output specification %s\n"), optArg);
+			*colon = 0;
+			for (target.format = 0; formats[target.format] != NULL; target.format++) {
+				if (strcmp(optArg, formats[target.format]) == 0)
+					break;
+			}
+			if (formats[target.format] == NULL)
+				fatal(_("Invalid output format %s\n"), optArg);
+			target.path = colon + 1;
+			VECTOR_APPEND(emitTargets, target);
+		END_OPTION
+		LONG_OPTION("output-format", REQUIRED_ARG)
+			if (option.dwfilterMode)
+				fatal(_("Option %.*s is not supported\n"), OPTPRARG);
+			comma = strchr(optArg, ',');
+			if (comma != NULL)
+				*comma++ = 0;
+			if (strcmp(optArg, "text") == 0)
+				option.outputFormat = FORMAT_TEXT;
+			else if (strcmp(optArg, "json") == 0)
+				option.outputFormat = FORMAT_JSON;
+			else if (strcmp(optArg, "binary") == 0)
+				option.outputFormat = FORMAT_BINARY;
+			else
+				fatal(_("Invalid output format %s\n"), optArg);
+			option.scriptText = false;
+			if (comma != NULL) {
+				if (strcmp(comma, "text") != 0 || option.outputFormat != FORMAT_JSON)
+					fatal(_("Invalid output format %s,%s\n"), optArg, comma);
+				option.scriptText = true;
+			}
+		END_OPTION
 		LONG_OPTION("profile", REQUIRED_ARG)
 			/* START_KEEP */
 			option.profile = optArg;
@@ -786,12 +945,66 @@ static PARSE_FUNCTION(parseArgs)
 	END_OPTIONS
 END_FUNCTION
 
+/** Check and complete the options for writing an edit script. */
+static void completeScriptOptions(void) {
+	if (option.diffInput)
+		fatal(_("Options --output-format and --diff-input can not be used together\n"));
+	if (option.detectMoves)
+		fatal(_("Options --output-format and --detect-moves can not be used together\n"));
+	if (option.paraDelim)
+		fatal(_("Options --output-format and --paragraph-separator can not be used together\n"));
+	/* The edit script contains all changes, and nothing else. */
+	option.printDeleted = option.printAdded = option.printCommon = true;
+	option.needMarkers = false;
+}
+
+/** Complete the options for printing an output requested with --emit.
+	@param target The @a EmitTarget to complete.
+	@param given The options as given, before completing the defaults.
+*/
+static void completeEmitTarget(EmitTarget *target, const option_t *given) {
+	option_t saved = option;
+
+	option = *given;
+	option.printer = option.less = false;
+	switch (target->format) {
+		case EMIT_MARKERS:
+		case EMIT_STATS:
+			option.colorMode = false;
+			break;
+		case EMIT_COLOR:
+			option.colorMode = true;
+			if (option.delColor == NULL) {
+				option.delColor = parseColor("bred");
+				option.addColor = parseColor("bgreen");
+				option.delColorLen = strlen(option.delColor);
+				option.addColorLen = strlen(option.addColor);
+			}
+			break;
+		case EMIT_JSON:
+		case EMIT_JSON_TEXT:
+		case EMIT_BINARY:
+			option.outputFormat = target->format == EMIT_BINARY ? FORMAT_BINARY : FORMAT_JSON;
+			option.scriptText = target->format == EMIT_JSON_TEXT;
+			break;
+		default:
+			PANIC();
+	}
+	completeDefaults();
+	if (option.outputFormat != FORMAT_TEXT)
+		completeScriptOptions();
+	target->options = option;
+	option = saved;
+}
+
 static PARSE_FUNCTION(preParseArgs)
 #include "option_stripped.inc"
 END_FUNCTION
 
 void parseCmdLine(int argc, char *argv[]) {
 	ProfileOption *profileOptions = NULL;
+	option_t given;
+	size_t i;
 	initializeOptions();
 	preParseArgs(argc, argv);
 	if (option.profile != NULL)
@@ -809,7 +1022,48 @@ void parseCmdLine(int argc, char *argv[]) {
 		if (option.newFile.name == NULL && option.newFile.input == NULL)
 			fatal(_("Need two files to compare\n"));
 	}
+	given = option;
 	completeDefaults();
+	if (option.window != 0 && option.detectMoves)
+		fatal(_("Options --window and --detect-moves can not be used together\n"));
+	if (option.incremental && option.detectMoves)
+		fatal(_("Options --incremental and --detect-moves can not be used together\n"));
+	if (option.brief && option.diffInput)
+		fatal(_("Options --brief and --diff-input can not be used together\n"));
+	if (option.outputFormat != FORMAT_TEXT)
+		completeScriptOptions();
+	/* With --brief, the exit status is the only output. */
+	if (option.brief)
+		option.statistics = option.similarity = false;
+	option.statisticsOnly = option.similarity || (!option.printDeleted && !option.printAdded && !option.printCommon);
 	postProcessOptions();
 	checkOverlap();
+
+	if (emitTargets.used != 0) {
+		if (option.outputFormat != FORMAT_TEXT)
+			fatal(_("Options --emit and --output-format can not be used together\n"));
+		if (option.diffInput)
+			fatal(_("Options --emit and --diff-input can not be used together\n"));
+		if (option.brief || option.similarity)
+			fatal(_("Options --emit and --brief or --similarity can not be used together\n"));
+		if (option.window != 0 || option.incremental)
+			fatal(_("Options --emit and --window or --incremental can not be used together\n"));
+		/* The edit script is printed once per output, after the comparison. */
+		option.statisticsOnly = false;
+		for (i = 0; i < emitTargets.used; i++) {
+			EmitTarget *target = &emitTargets.data[i];
+
+			completeEmitTarget(target, &given);
+			if (target->options.outputFormat != FORMAT_TEXT)
+				option.tokenPositions = true;
+			if (target->options.outputFormat == FORMAT_TEXT ? target->format != EMIT_STATS : target->options.scriptText)
+				option.spoolInput = true;
+		}
+	} else {
+		option.tokenPositions = option.outputFormat != FORMAT_TEXT;
+		option.spoolInput = !option.statisticsOnly && (option.outputFormat == FORMAT_TEXT || option.scriptText);
+	}
+	initOutput();
+	if (option.outputBuffers != 0 && !option.statisticsOnly)
+		initOutputBuffers(option.outputBuffers);
 }
@@ -16,7 +16,37 @@
 #define OPTION_H
 
 #define DEFAULT_LINENUMBER_WIDTH 4
+#define DEFAULT_ALIGN_CHUNK_SIZE 1024
+#define DEFAULT_WINDOW_SIZE 1048576
+#define MIN_WINDOW_SIZE 1024
+#define DEFAULT_OUTPUT_BUFFERS 4
+#define MAX_OUTPUT_BUFFERS 1024
 #define BITMASK_SIZE (UCHAR_MAX+7)/8
+
+/* Values for option.outputFormat. */
+enum {
+	FORMAT_TEXT,
+	FORMAT_JSON,
+	FORMAT_BINARY
+};
+
+/* Values for option.profilePhases. */
+enum {
+	PHASES_NONE,
+	PHASES_TEXT,
+	PHASES_JSON
+};
+
+/* Formats for --emit. */
+enum {
+	EMIT_MARKERS,
+	EMIT_COLOR,
+	EMIT_STATS,
+	EMIT_JSON,
+	EMIT_JSON_TEXT,
+	EMIT_BINARY
+};
+
 typedef struct {
 	InputFile oldFile,
 		newFile;
@@ -32,6 +62,19 @@ typedef struct {
 		addStopLen,
 		delColorLen,
 		addColorLen;
+	/* Markers and colors for text that was moved. */
+	const char *moveDelStart,
+		*moveDelStop,
+		*moveAddStart,
+		*moveAddStop;
+	char *moveDelColor,
+		*moveAddColor;
+	size_t moveDelStartLen,
+		moveDelStopLen,
+		moveAddStartLen,
+		moveAddStopLen,
+		moveDelColorLen,
+		moveAddColorLen;
 	/* Bitmaps for single byte checking. */
 	char delimiters[BITMASK_SIZE],
 		whitespace[BITMASK_SIZE];
@@ -68,10 +111,45 @@ typedef struct {
 	bool dwfilterMode;
 	bool repeatMarkers;
 	bool diffInput;
+	unsigned detectMoves;
+	/* Number of tokens per input to diff at a time, or 0 to diff the inputs as a whole. */
+	size_t window;
+	bool incremental;
+	/* Only compute and print the statistics, for --similarity. */
+	bool similarity;
+	/* Only determine whether the files differ, for --brief. */
+	bool brief;
+	/* Nothing but the statistics is printed, so the input need not be read
+	   back after the comparison. Set for --similarity, or -1 -2 -3. */
+	bool statisticsOnly;
+	/* The FORMAT_* value selected with --output-format, and whether the text
+	   of the changes is included in the edit script. */
+	int outputFormat;
+	bool scriptText;
+	/* Whether the positions of the tokens are recorded, for the edit script. */
+	bool tokenPositions;
+	/* Whether the input is copied to temporary files, to be printed later. */
+	bool spoolInput;
+	/* Number of output buffers for the writer thread, or 0 to write from the
+	   main thread. */
+	int outputBuffers;
+	/* The PHASES_* format in which to print the time and memory used per
+	   phase, for --profile-phases. */
+	int profilePhases;
 } option_t;
 
 extern option_t option;
 
+/* An output requested with --emit, and the options to print it with. */
+typedef struct {
+	int format;
+	const char *path;
+	option_t options;
+} EmitTarget;
+
+typedef VECTOR(EmitTarget, EmitTargetVector);
+extern EmitTargetVector emitTargets;
+
 void parseCmdLine(int argc, char *argv[]);
 
 #endif
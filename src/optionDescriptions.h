@@ -36,8 +36,15 @@ N_("-3, --no-common                        Do not print common words\n"),
 N_("-L[<width>], --line-numbers[<width>]   Prepend line numbers\n"),
 N_("-C<num>, --context=<num>               Show <num> lines of context\n"),
 N_("-s, --statistics                       Print statistics when done\n"),
+N_("--similarity                           Only print statistics, to standard output\n"),
+N_("-q, --brief                            Only report differences in the exit status\n"),
+N_("--output-format=<fmt>                  Write the changes as text, json[,text] or binary\n"),
+N_("--emit=<fmt>:<file>                    Write the output in format <fmt> to <file> (- for stdout)\n"),
+N_("--profile-phases[=<fmt>]               Print time and memory per phase as text or json\n"),
 #endif
 N_("--wdiff-output                         Produce wdiff compatible output\n"),
+N_("--incremental                          Start output before comparison is done\n"),
+N_("--output-buffers[=<num>]               Write output from a thread with <num> buffers\n"),
 
 /* Options changing the matching */
 N_("-i, --ignore-case                      Ignore differences in case\n"),
@@ -54,7 +61,11 @@ N_("-m <num>, --match-context=<num>        Use <num> words of context for matchi
    can live with multiple changes that are within (2 * match-context + 1) words
    from eachother being reported as a single change, they can use this option. */
 N_("--aggregate-changes                    Allow close changes to aggregate\n"),
-N_("-A <alg>, --algorithm=<alg>            Choose algorithm: best, normal, fast\n"),
+N_("-A <alg>, --algorithm=<alg>            Choose algorithm: auto, best, normal, fast\n"),
+N_("--max-diff-time=<msec>                 Approximate changes after <msec> ms\n"),
+N_("--max-diff-memory=<MiB>                Approximate changes needing more memory\n"),
+N_("--align-chunks[=<num>]                 Align large inputs on chunks of <num> words\n"),
+N_("--window[=<num>]                       Compare <num> words at a time\n"),
 
 #ifdef DWDIFF_COMPILE
 /* Options changing the appearance of the output */
@@ -66,6 +77,12 @@ N_("-x <string>, --stop-delete=<string>    String to mark end of deleted text\n"
 N_("-y <string>, --start-insert=<string>   String to mark begin of inserted text\n"),
 N_("-z <string>, --stop-insert=<string>    String to mark end of inserted text\n"),
 N_("-R, --repeat-markers                   Repeat markers at newlines\n"),
+N_("--detect-moves[=<num>]                 Mark moved blocks of at least <num> words\n"),
+N_("--start-move-delete=<string>           String to mark begin of moved-away text\n"),
+N_("--stop-move-delete=<string>            String to mark end of moved-away text\n"),
+N_("--start-move-insert=<string>           String to mark begin of moved-in text\n"),
+N_("--stop-move-insert=<string>            String to mark end of moved-in text\n"),
+N_("--move-color=<spec>                    Colors for moved text\n"),
 #endif
 
 #ifdef DWFILTER_COMPILE
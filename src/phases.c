@@ -0,0 +1,195 @@
+/* Copyright (C) 2026 agent <agent@local>
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License version 3, as
+   published by the Free Software Foundation.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/* Time and memory use of the phases of a run, for --profile-phases. When the
+   option is not given, phaseStart and phaseEnd return immediately, such that
+   the instrumented code is not slowed down. */
+
+#include <stdio.h>
+#include <time.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include "definitions.h"
+#include "util.h"
+#include "hashtable.h"
+#include "buffer.h"
+#include "phases.h"
+
+typedef struct {
+	const char *name;
+	/* The number of times the phase was started, and the nesting depth of
+	   the phase. Only the outermost start and end are timed, for recursive
+	   phases. */
+	unsigned long calls;
+	int depth;
+	/* Wall clock and CPU time in seconds, and the values at the start. */
+	double wall, cpu, wallStart, cpuStart;
+	/* Token lookups in the hash table and the lookups which found an existing
+	   token, and the values at the start. */
+	unsigned long lookups, hits, lookupsStart, hitsStart;
+	long long bytes, tokens;
+	/* How much the peak memory use of the process grew during the phase in
+	   KiB, and the peak memory use at the start. */
+	long peakGrowth, peakStart;
+} PhaseData;
+
+static PhaseData phases[PHASE_COUNT] = {
+	{ .name = "read-old" },
+	{ .name = "read-new" },
+	{ .name = "diff" },
+	{ .name = "discard" },
+	{ .name = "compare" },
+	{ .name = "shift" },
+	{ .name = "match-context" },
+	{ .name = "output" }
+};
+
+static bool enabled;
+static double startWall, startCPU;
+
+/** Get the wall clock time in seconds. */
+static double getWallTime(void) {
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+/** Get the CPU time used in seconds, of all threads.
+	@param peakMemory Returns the peak memory use in KiB.
+*/
+static double getCPUTime(long *peakMemory) {
+	struct rusage usage;
+
+	getrusage(RUSAGE_SELF, &usage);
+	*peakMemory = usage.ru_maxrss;
+	return usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6 + usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1e6;
+}
+
+/** Start measuring the phases. */
+void initPhases(void) {
+	long peakMemory;
+
+	enabled = true;
+	startCPU = getCPUTime(&peakMemory);
+	startWall = getWallTime();
+}
+
+/** Mark the start of a phase.
+	@param phase The phase which starts.
+*/
+void phaseStart(Phase phase) {
+	PhaseData *data = &phases[phase];
+
+	if (!enabled)
+		return;
+	data->calls++;
+	if (data->depth++ != 0)
+		return;
+	data->lookupsStart = hashStatistics.lookups;
+	data->hitsStart = hashStatistics.hits;
+	data->cpuStart = getCPUTime(&data->peakStart);
+	data->wallStart = getWallTime();
+}
+
+/** Mark the end of a phase.
+	@param phase The phase which ends.
+*/
+void phaseEnd(Phase phase) {
+	PhaseData *data = &phases[phase];
+	long peakMemory;
+
+	if (!enabled || --data->depth != 0)
+		return;
+	data->wall += getWallTime() - data->wallStart;
+	data->cpu += getCPUTime(&peakMemory) - data->cpuStart;
+	data->peakGrowth += peakMemory - data->peakStart;
+	data->lookups += hashStatistics.lookups - data->lookupsStart;
+	data->hits += hashStatistics.hits - data->hitsStart;
+}
+
+/** Add to the amount of data processed in a phase.
+	@param phase The phase to add to.
+	@param bytes The number of bytes processed.
+	@param tokens The number of tokens processed.
+*/
+void phaseCount(Phase phase, long long bytes, long long tokens) {
+	if (!enabled)
+		return;
+	phases[phase].bytes += bytes;
+	phases[phase].tokens += tokens;
+}
+
+/** Print the measurements of all phases.
+	@param stream The stream to print to.
+	@param json Whether to print the measurements as a JSON object, rather
+		than as a table.
+*/
+void printPhases(FILE *stream, bool json) {
+	double wall = getWallTime() - startWall;
+	long peakMemory;
+	double cpu = getCPUTime(&peakMemory) - startCPU;
+	unsigned long unique = hashStatistics.lookups - hashStatistics.hits;
+	/* The choices of --algorithm=auto, if it made any. */
+	bool autoChoices = diff_algorithm == DIFF_AUTO && diff_auto_lines > 0;
+	static const char *algorithmNames[] = { "auto", "best", "normal", "fast" };
+	int i;
+
+	/* The output is written in blocks, so the bytes are only known at the end. */
+	phases[PHASE_OUTPUT].bytes = getBytesWritten();
+
+	if (json) {
+		fprintf(stream, "{\"phases\":[");
+		for (i = 0; i < PHASE_COUNT; i++) {
+			PhaseData *data = &phases[i];
+
+			fprintf(stream, "%s{\"name\":\"%s\",\"calls\":%lu,\"wall_ms\":%.3f,\"cpu_ms\":%.3f,\"bytes\":%lld,"
+				"\"tokens\":%lld,\"lookups\":%lu,\"unique\":%lu,\"peak_growth_kib\":%ld}", i == 0 ? "" : ",",
+				data->name, data->calls, data->wall * 1000, data->cpu * 1000, data->bytes, data->tokens,
+				data->lookups, data->lookups - data->hits, data->peakGrowth);
+		}
+		fprintf(stream, "],\"total\":{\"wall_ms\":%.3f,\"cpu_ms\":%.3f,\"peak_kib\":%ld},"
+			"\"interning\":{\"lookups\":%lu,\"hits\":%lu,\"unique\":%lu,\"collisions\":%lu}",
+			wall * 1000, cpu * 1000, peakMemory, hashStatistics.lookups, hashStatistics.hits, unique,
+			hashStatistics.collisions);
+		if (autoChoices)
+			fprintf(stream, ",\"algorithm\":{\"best\":%ld,\"normal\":%ld,\"fast\":%ld,\"largest\":{\"name\":\"%s\","
+				"\"aligned\":%s,\"items\":%ld,\"estimate\":%ld}}", (long) diff_auto_count[DIFF_BEST],
+				(long) diff_auto_count[DIFF_NORMAL], (long) diff_auto_count[DIFF_FAST], algorithmNames[diff_auto_choice],
+				diff_auto_aligned ? "true" : "false", (long) diff_auto_lines, (long) diff_auto_changes);
+		fprintf(stream, "}\n");
+		return;
+	}
+
+	fprintf(stream, "%-14s %8s %10s %10s %12s %10s %10s %10s %10s\n", _("phase"), _("calls"), _("wall ms"),
+		_("cpu ms"), _("bytes"), _("tokens"), _("lookups"), _("unique"), _("peak +KiB"));
+	for (i = 0; i < PHASE_COUNT; i++) {
+		PhaseData *data = &phases[i];
+
+		fprintf(stream, "%-14s %8lu %10.3f %10.3f %12lld %10lld %10lu %10lu %10ld\n", data->name, data->calls,
+			data->wall * 1000, data->cpu * 1000, data->bytes, data->tokens, data->lookups,
+			data->lookups - data->hits, data->peakGrowth);
+	}
+	fprintf(stream, "%-14s %8s %10.3f %10.3f %12s %10s %10s %10s %10ld\n", _("total"), "", wall * 1000, cpu * 1000,
+		"", "", "", "", peakMemory);
+	fprintf(stream, _("interning: %lu lookups, %lu hits, %lu unique, %lu collisions\n"), hashStatistics.lookups,
+		hashStatistics.hits, unique, hashStatistics.collisions);
+	if (autoChoices) {
+		fprintf(stream, _("algorithm: %ld best, %ld normal, %ld fast comparisons\n"), (long) diff_auto_count[DIFF_BEST],
+			(long) diff_auto_count[DIFF_NORMAL], (long) diff_auto_count[DIFF_FAST]);
+		fprintf(stream, _("algorithm: largest comparison used %s%s: %ld items, at least %ld deleted plus inserted\n"),
+			algorithmNames[diff_auto_choice], diff_auto_aligned ? _(" with chunk alignment") : "",
+			(long) diff_auto_lines, (long) diff_auto_changes);
+	}
+}
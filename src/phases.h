@@ -0,0 +1,45 @@
+/* Copyright (C) 2026 agent <agent@local>
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License version 3, as
+   published by the Free Software Foundation.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef PHASES_H
+#define PHASES_H
+
+#include <stdio.h>
+#include "definitions.h"
+
+/* The phases measured for --profile-phases. Phases may be nested in other
+   phases, in which case their time is included in both. */
+typedef enum {
+	/* Reading and tokenizing the old and new file, including interning the tokens. */
+	PHASE_READ_OLD,
+	PHASE_READ_NEW,
+	/* All calls of diff_2_files, and the parts of it. */
+	PHASE_DIFF,
+	PHASE_DISCARD,
+	PHASE_COMPARE,
+	PHASE_SHIFT,
+	/* Building the context tokens and refining the changes for --match-context. */
+	PHASE_MATCH_CONTEXT,
+	/* Printing the output. */
+	PHASE_OUTPUT,
+	PHASE_COUNT
+} Phase;
+
+void initPhases(void);
+void phaseStart(Phase phase);
+void phaseEnd(Phase phase);
+void phaseCount(Phase phase, long long bytes, long long tokens);
+void printPhases(FILE *stream, bool json);
+
+#endif
@@ -0,0 +1,263 @@
+/* Copyright (C) 2026 agent <agent@local>
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License version 3, as
+   published by the Free Software Foundation.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/* Machine readable output of the edit script, for --output-format. Each change
+   is written directly from the edit script and the token positions recorded
+   while reading the input, so the text itself is only read back from the
+   temporary files when it is included in the script. */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "definitions.h"
+#include "option.h"
+#include "util.h"
+#include "stream.h"
+#include "buffer.h"
+#include "script.h"
+
+/* The record being built, and the text of the changed tokens. */
+static CharBuffer record, text;
+
+/** Get the byte offsets and lines of a range of tokens.
+	@param file The @a InputFile the tokens are from.
+	@param first The first token of the range.
+	@param count The number of tokens in the range.
+	@param offsets Returns the start and end offset of the range.
+	@param lines Returns the first and last line of the range.
+
+	An empty range is located at the start of token @a first, or at the end of
+	the text if there is no such token.
+*/
+static void getRange(const InputFile *file, lin first, lin count, off_t *offsets, lin *lines) {
+	if (count > 0) {
+		offsets[0] = file->positions.data[first].start;
+		lines[0] = file->positions.data[first].firstLine;
+		offsets[1] = file->positions.data[first + count - 1].end;
+		lines[1] = file->positions.data[first + count - 1].lastLine;
+	} else if ((size_t) first < file->positions.used) {
+		offsets[0] = offsets[1] = file->positions.data[first].start;
+		lines[0] = lines[1] = file->positions.data[first].firstLine;
+	} else {
+		offsets[0] = offsets[1] = file->textOffset;
+		lines[0] = lines[1] = file->textLine;
+	}
+}
+
+/** Read one token or piece of whitespace from a temporary file.
+	@param stream The @a Stream to read from.
+	@param keep Whether to append the characters to @a text.
+*/
+static void readRecord(Stream *stream, bool keep) {
+	int c;
+
+	while ((c = sgetc(stream)) != 0) {
+		/* Unescape the characters, if necessary. */
+		if (c == EOF || (c == 1 && (c = sgetc(stream)) == EOF))
+			fatal(_("Error reading back input\n"));
+		if (keep)
+			VECTOR_APPEND(text, c);
+	}
+}
+
+/** Read the text of a range of tokens into @a text.
+	@param file The @a InputFile to read from.
+	@param first The first token of the range.
+	@param count The number of tokens in the range.
+
+	The temporary files are read sequentially, so the ranges must be read in
+	increasing order. The text consists of the tokens and the whitespace in
+	between them.
+*/
+static void readText(InputFile *file, lin first, lin count) {
+	text.used = 0;
+	for (; file->lastPrinted < first + count; file->lastPrinted++) {
+		readRecord(file->whitespace->stream, file->lastPrinted > first);
+		readRecord(file->tokens->stream, file->lastPrinted >= first);
+	}
+}
+
+/** Append a string to @a record. */
+static void appendString(const char *string) {
+	size_t length = strlen(string);
+
+	VECTOR_ALLOCATE(record, length);
+	memcpy(record.data + record.used, string, length);
+	record.used += length;
+}
+
+/** Append a number to @a record. */
+static void appendNumber(long long value) {
+	char buffer[24];
+
+	snprintf(buffer, sizeof(buffer), "%lld", value);
+	appendString(buffer);
+}
+
+/** Append @a text to @a record as a JSON string.
+
+	Bytes that do not form UTF-8 in single byte mode are written as the code
+	point with the same value, such that the original bytes can be recovered.
+*/
+static void appendText(void) {
+	static const char hex[] = "0123456789abcdef";
+	size_t i;
+
+	VECTOR_APPEND(record, '"');
+	for (i = 0; i < text.used; i++) {
+		unsigned char c = text.data[i];
+
+		VECTOR_ALLOCATE(record, 6);
+		switch (c) {
+			case '"':
+			case '\\':
+				record.data[record.used++] = '\\';
+				record.data[record.used++] = c;
+				continue;
+			case '\n':
+				record.data[record.used++] = '\\';
+				record.data[record.used++] = 'n';
+				continue;
+			case '\r':
+				record.data[record.used++] = '\\';
+				record.data[record.used++] = 'r';
+				continue;
+			case '\t':
+				record.data[record.used++] = '\\';
+				record.data[record.used++] = 't';
+				continue;
+			default:
+				break;
+		}
+		if (c < 0x20 || c == 0x7f || (c >= 0x80 && !SWITCH_UNICODE(UTF8Mode, false))) {
+			memcpy(record.data + record.used, "\\u00", 4);
+			record.data[record.used + 4] = hex[c >> 4];
+			record.data[record.used + 5] = hex[c & 0xf];
+			record.used += 6;
+		} else {
+			record.data[record.used++] = c;
+		}
+	}
+	VECTOR_APPEND(record, '"');
+}
+
+/** Append a pair of numbers to @a record as a JSON array. */
+static void appendPair(long long first, long long second) {
+	VECTOR_APPEND(record, '[');
+	appendNumber(first);
+	VECTOR_APPEND(record, ',');
+	appendNumber(second);
+	VECTOR_APPEND(record, ']');
+}
+
+/** Append the description of a range of tokens to @a record as a JSON object.
+	@param file The @a InputFile the tokens are from.
+	@param first The first token of the range.
+	@param count The number of tokens in the range.
+*/
+static void appendRange(InputFile *file, lin first, lin count) {
+	off_t offsets[2];
+	lin lines[2];
+
+	getRange(file, first, count, offsets, lines);
+	appendString("{\"tokens\":");
+	appendPair(first, first + count);
+	appendString(",\"bytes\":");
+	appendPair(offsets[0], offsets[1]);
+	appendString(",\"lines\":");
+	appendPair(lines[0], lines[1]);
+	if (option.scriptText) {
+		readText(file, first, count);
+		appendString(",\"text\":");
+		appendText();
+	}
+	VECTOR_APPEND(record, '}');
+}
+
+/** Store a number in little endian byte order.
+	@param buffer The location to store the number.
+	@param value The number to store.
+	@param bytes The number of bytes to use.
+*/
+static void storeNumber(char *buffer, unsigned long long value, int bytes) {
+	int i;
+
+	for (i = 0; i < bytes; i++, value >>= 8)
+		buffer[i] = value & 0xff;
+}
+
+/** Store the description of a range of tokens in a binary record.
+	@param buffer The location to store the description, which takes 48 bytes.
+	@param file The @a InputFile the tokens are from.
+	@param first The first token of the range.
+	@param count The number of tokens in the range.
+*/
+static void storeRange(char *buffer, const InputFile *file, lin first, lin count) {
+	off_t offsets[2];
+	lin lines[2];
+
+	getRange(file, first, count, offsets, lines);
+	storeNumber(buffer, first, 8);
+	storeNumber(buffer + 8, first + count, 8);
+	storeNumber(buffer + 16, offsets[0], 8);
+	storeNumber(buffer + 24, offsets[1], 8);
+	storeNumber(buffer + 32, lines[0], 8);
+	storeNumber(buffer + 40, lines[1], 8);
+}
+
+/** Write the start of the edit script. */
+void writeScriptHeader(void) {
+	char header[SCRIPT_HEADER_SIZE];
+
+	if (option.outputFormat != FORMAT_BINARY)
+		return;
+	memcpy(header, SCRIPT_MAGIC, 8);
+	storeNumber(header + 8, SCRIPT_VERSION, 4);
+	storeNumber(header + 12, SCRIPT_RECORD_SIZE, 4);
+	outputWrite(header, sizeof(header));
+}
+
+/** Write changes in the format selected with --output-format.
+	@param script The changes to write.
+	@param count The number of changes in @a script.
+*/
+void writeScript(const struct change *script, size_t count) {
+	static const char *names[] = { "delete", "insert", "change" };
+	size_t i;
+
+	for (i = 0; i < count; i++, script++) {
+		int op = script->inserted == 0 ? SCRIPT_DELETE : (script->deleted == 0 ? SCRIPT_INSERT : SCRIPT_CHANGE);
+
+		if (option.outputFormat == FORMAT_BINARY) {
+			char binary[SCRIPT_RECORD_SIZE];
+
+			storeNumber(binary, op, 4);
+			storeNumber(binary + 4, 0, 4);
+			storeRange(binary + 8, &option.oldFile, script->line0, script->deleted);
+			storeRange(binary + 56, &option.newFile, script->line1, script->inserted);
+			outputWrite(binary, sizeof(binary));
+			continue;
+		}
+
+		record.used = 0;
+		appendString("{\"op\":\"");
+		appendString(names[op]);
+		appendString("\",\"old\":");
+		appendRange(&option.oldFile, script->line0, script->deleted);
+		appendString(",\"new\":");
+		appendRange(&option.newFile, script->line1, script->inserted);
+		appendString("}\n");
+		outputWrite(record.data, record.used);
+	}
+}
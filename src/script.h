@@ -0,0 +1,42 @@
+/* Copyright (C) 2026 agent <agent@local>
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License version 3, as
+   published by the Free Software Foundation.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef SCRIPT_H
+#define SCRIPT_H
+
+#include "definitions.h"
+
+/* Layout of the binary edit script. All numbers are stored little endian. The
+   file starts with a header of SCRIPT_HEADER_SIZE bytes: the magic string
+   "DWSCRIPT", followed by the format version and the record size as 32 bit
+   numbers. Then follows a record of SCRIPT_RECORD_SIZE bytes per change: the
+   SCRIPT_* operation and a reserved field as 32 bit numbers, followed by six
+   64 bit numbers for the old and six for the new text: the first token, the
+   token after the last, the start and end byte offset and the first and last
+   line. */
+#define SCRIPT_MAGIC "DWSCRIPT"
+#define SCRIPT_VERSION 1
+#define SCRIPT_HEADER_SIZE 16
+#define SCRIPT_RECORD_SIZE 104
+
+enum {
+	SCRIPT_DELETE,
+	SCRIPT_INSERT,
+	SCRIPT_CHANGE
+};
+
+void writeScriptHeader(void);
+void writeScript(const struct change *script, size_t count);
+
+#endif
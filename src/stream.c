@@ -25,6 +25,7 @@ static void initStreamDefault(Stream *stream) {
 	stream->highSurrogate = 0;
 	stream->lastClusterCategory = 0;
 	stream->nextChar = -1;
+	stream->charOffset = stream->nextCharOffset = 0;
 #endif
 }
 
@@ -85,21 +86,40 @@ Stream *newStringStream(const char *string, size_t length) {
 	Stream *retval;
 
 	retval = safe_malloc(sizeof(Stream));
+	initStringStream(retval, string, length);
+	return retval;
+}
 
-	retval->vtable = &stringVtable;
-	retval->data.string.string = string;
-	retval->data.string.index = 0;
-	retval->data.string.length = length;
-
-	initStreamDefault(retval);
+/** Initialize a string based stream in caller provided storage.
+    @param stream The @a Stream to initialize.
+    @param string The string to wrap.
+    @param length The length of @a string.
+*/
+void initStringStream(Stream *stream, const char *string, size_t length) {
+	stream->vtable = &stringVtable;
+	stream->data.string.string = string;
+	stream->data.string.index = 0;
+	stream->data.string.length = length;
 
-	return retval;
+	initStreamDefault(stream);
 }
 
 bool isFileStream(const Stream *stream) {
 	return stream->vtable == &fileVtable;
 }
 
+/** Set the read position of a @a File based stream.
+    @param stream The @a Stream to reposition.
+    @param offset The new position.
+    @return 0 on success, -1 on failure.
+
+    Any characters read ahead for (grapheme) cluster breaking are discarded.
+*/
+int sfseek(Stream *stream, off_t offset) {
+	initStreamDefault(stream);
+	return fileSeek(stream->data.file, offset);
+}
+
 void sfclose(Stream *stream) {
 	fileClose(stream->data.file);
 	free(stream);
@@ -47,17 +47,23 @@ struct Stream {
 
 	/* Character already read when checking for low surrogate. */
 	UChar32 nextChar;
+
+	/* Input offsets at which the last character returned by getucFiltered and
+	   nextChar start, for reporting the raw bytes taken by a cluster. */
+	off_t charOffset, nextCharOffset;
 #endif
 };
 
 Stream *newFileStream(File *file);
 Stream *newStringStream(const char *string, size_t length);
+void initStringStream(Stream *stream, const char *string, size_t length);
 bool isFileStream(const Stream *stream);
 
 #define sferror(s) (fileError((s)->data.file))
 #define sfflush(s) (fileFlush((s)->data.file))
 #define srewind(s) (fileRewind((s)->data.file, FILE_READ))
 #define sfeof(s) (fileEof((s)->data.file))
+#define sftell(s) (fileTell((s)->data.file))
 
 // Note: this gets a single byte character, rather than a UTF-8 character
 #define sgetc(s) (fileGetc((s)->data.file))
@@ -65,6 +71,7 @@ bool isFileStream(const Stream *stream);
 #define swrite(s, buf, bytes) (fileWrite((s)->data.file, buf, bytes))
 #define sgeterrno(s) (fileGetErrno((s)->data.file))
 
+int sfseek(Stream *stream, off_t offset);
 void sfclose(Stream *stream);
 
 #endif
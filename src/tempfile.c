@@ -20,7 +20,7 @@
 #include "definitions.h"
 #include "stream.h"
 
-static TempFile files[6];
+static TempFile files[8];
 static unsigned openIndex = 0;
 
 #ifndef LEAVE_FILES
@@ -31,6 +31,7 @@ static bool inited;
 /** Create a temporary file. */
 TempFile *tempFile(void) {
 #ifndef LEAVE_FILES
+	mode_t mask;
 	int fd;
 #endif
 
@@ -44,15 +45,19 @@ TempFile *tempFile(void) {
 #else
 	/* Create temporary file. */
 	if (!inited) {
-		/* Make sure the umask is set so that we don't introduce a security risk. */
-		umask(~S_IRWXU);
 		/* Make sure we will remove temporary files on exit. */
 		atexit(resetTempFiles);
 		inited = true;
 	}
 
+	/* Make sure the umask is set so that we don't introduce a security risk.
+	   The umask is restored afterwards, such that the files written with
+	   --emit get the usual permissions. */
+	mask = umask(~S_IRWXU);
 	strcpy(files[openIndex].name, TEMPLATE);
-	if ((fd = mkstemp(files[openIndex].name)) < 0)
+	fd = mkstemp(files[openIndex].name);
+	umask(mask);
+	if (fd < 0)
 		return NULL;
 	if ((files[openIndex].stream = newFileStream(fileWrapFD(fd, FILE_WRITE))) == NULL)
 		return NULL;
@@ -116,6 +116,11 @@ static UChar32 getuc(Stream *stream) {
 
 #define REPLACEMENT_CHARACTER 0xFFFD;
 
+/** Get the current read position in a @a Stream. */
+static off_t streamTell(const Stream *stream) {
+	return isFileStream(stream) ? sftell(stream) : (off_t) stream->data.string.index;
+}
+
 /** Get a character from a @a Stream, converting strange characters to REPLACEMENT CHARACTER.
     @param stream The @a Stream to read from.
     @return a UCS-4 character or EOF on end-of-file or error.
@@ -126,7 +131,9 @@ UChar32 getucFiltered(Stream *stream) {
 	if (stream->nextChar >= 0) {
 		c = stream->nextChar;
 		stream->nextChar = -1;
+		stream->charOffset = stream->nextCharOffset;
 	} else {
+		stream->charOffset = streamTell(stream);
 		c = getuc(stream);
 	}
 
@@ -139,6 +146,7 @@ UChar32 getucFiltered(Stream *stream) {
 		if ((c & 0xDC00) == 0xDC00)
 			return REPLACEMENT_CHARACTER;
 
+		stream->nextCharOffset = streamTell(stream);
 		clow = getuc(stream);
 
 		if ((clow & 0xFC00) != 0xDC00) {
@@ -364,6 +372,17 @@ bool getCluster(Stream *stream, UTF16Buffer *buffer) {
 	return getClusterInternal(stream, buffer, clusterContinuationTable);
 }
 
+/** Get the offset in a stream just past the last cluster read from it.
+    @param stream The @a Stream read by @a getCluster.
+    @return the number of raw input bytes consumed by the clusters read so far.
+
+    Because invalid input is replaced, the clusters themselves do not tell how
+    many bytes they took from the input.
+*/
+off_t getClusterEnd(const Stream *stream) {
+	return stream->bufferedChar < 0 ? streamTell(stream) : stream->charOffset;
+}
+
 /** Get the next Backspace Cluster from a stream.
     @param stream The @a Stream to read.
     @param buffer The @a UTF16Buffer to store the Backspace Cluster.
@@ -47,6 +47,7 @@ typedef VECTOR(UChar, UTF16Buffer);
 typedef VECTOR(UTF16Buffer, CharList);
 
 bool getCluster(Stream *stream, UTF16Buffer *buffer);
+off_t getClusterEnd(const Stream *stream);
 bool getBackspaceCluster(Stream *stream, UTF16Buffer *buffer);
 int convertToUTF8(UChar32 c, char *buffer);
 int filteredConvertToUTF8(UChar32 c, char *buffer, UChar32 *highSurrogate);
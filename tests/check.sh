@@ -0,0 +1,126 @@
+#!/bin/sh
+# Regression tests for dwdiff. Usage: tests/check.sh <path to dwdiff>
+
+DWDIFF="$1"
+if [ -z "${DWDIFF}" ] ; then
+	echo "Usage: $0 <path to dwdiff>"
+	exit 2
+fi
+case "${DWDIFF}" in
+	/*) ;;
+	*) DWDIFF="`pwd`/${DWDIFF}" ;;
+esac
+
+TMPDIR="`mktemp -d`" || exit 2
+trap 'rm -rf "${TMPDIR}"' 0
+cd "${TMPDIR}" || exit 2
+
+failures=0
+tests=0
+
+fail() {
+	echo "FAIL: $*"
+	failures=`expr ${failures} + 1`
+}
+
+# Generate the files old and new with random words. From word <from> on,
+# every <step>th word of new is changed.
+# Usage: generate <words> <vocabulary size> <from> <step>
+generate() {
+	awk -v n="$1" -v voc="$2" -v from="$3" -v step="$4" 'BEGIN {
+		srand(1);
+		for (i = 0; i < n; i++) {
+			w = "w" int(rand() * voc);
+			sep = i % 10 == 9 ? "\n" : " ";
+			printf "%s%s", w, sep > "old";
+			if (i >= from && i % step == 0)
+				w = "x" w;
+			printf "%s%s", w, sep > "new";
+		}
+	}'
+}
+
+# Generate the files old and new as a log of <lines> lines, in which new has
+# some lines with other words. Each line has unique words, which are
+# discarded from the comparison.
+# Usage: generate_log <lines>
+generate_log() {
+	awk -v n="$1" 'BEGIN {
+		srand(1);
+		for (i = 0; i < n; i++) {
+			ms = int(rand() * 400);
+			status = rand() < 0.8 ? 200 : 404;
+			line = "t" i " request " i " handled in " ms " ms status=" status;
+			print line > "old";
+			if (rand() < 0.07)
+				line = "t" i " request " i " dropped in " ms " ms state=" status;
+			print line > "new";
+		}
+	}'
+}
+
+# Get the number of times the output phase was entered, from --profile-phases=json.
+output_calls() {
+	"${DWDIFF}" --profile-phases=json "$@" 2>&1 >/dev/null | sed -n 's/.*"name":"output","calls":\([0-9]*\).*/\1/p'
+}
+
+# --incremental must print the same as a normal run, including for the
+# comparisons refining a large change with --match-context.
+test_incremental_refine() {
+	generate 100000 50 50000 5
+	for m in 1 2 3 ; do
+		"${DWDIFF}" -m$m old new > expected
+		"${DWDIFF}" -m$m --incremental old new > result
+		status=$?
+		[ ${status} -eq 1 ] || fail "--incremental -m$m exits with status ${status}"
+		cmp -s expected result || fail "--incremental -m$m output differs"
+	done
+}
+
+# With --incremental, output must start before the comparison is done, which
+# is visible as extra entries of the output phase.
+test_incremental_early() {
+	generate_log 40000
+	normal=`output_calls old new`
+	incremental=`output_calls --incremental old new`
+	[ "${incremental:-0}" -gt "${normal:-0}" ] || \
+		fail "--incremental prints no output during the comparison (${incremental} vs ${normal} output calls)"
+	"${DWDIFF}" old new > expected
+	"${DWDIFF}" --incremental old new > result
+	cmp -s expected result || fail "--incremental output differs"
+}
+
+# Files written by --emit get the permissions of the umask, also when
+# temporary files are used.
+test_emit_mode() {
+	generate 1000 50 0 7
+	(umask 022 && "${DWDIFF}" --emit=markers:markers --emit=json:json old new)
+	for file in markers json ; do
+		mode=`ls -l "${file}" | cut -c1-10`
+		[ "${mode}" = "-rw-r--r--" ] || fail "--emit file ${file} has mode ${mode}"
+	done
+}
+
+# The search for the midpoint must give the same result on the helper thread,
+# which is forced with DWDIFF_FORCE_THREADS.
+test_threaded_search() {
+	generate 20000 50 0 3
+	for options in "" "-A best" "-A fast" "-m0" "-m3" ; do
+		(unset DWDIFF_FORCE_THREADS ; "${DWDIFF}" ${options} old new > expected)
+		DWDIFF_FORCE_THREADS=1 "${DWDIFF}" ${options} old new > result
+		cmp -s expected result || fail "output of the threaded search differs for options '${options}'"
+	done
+}
+
+run_test() {
+	tests=`expr ${tests} + 1`
+	"$1"
+}
+
+run_test test_incremental_refine
+run_test test_incremental_early
+run_test test_emit_mode
+run_test test_threaded_search
+
+echo "${tests} tests run, ${failures} failures"
+[ ${failures} -eq 0 ]